@@ -4,7 +4,7 @@
 //  -------------------------------------------------
 //  + FS.img: 文件系统映像 (mkfs.c)
 //  + VirtIO: 虚拟硬盘驱动 (virtio.h virtio_disk.c)
-//  + BCache: LRU缓存链环 (buf.h bio.c)
+//  + BCache: LRU缓存哈希表 (buf.h bio.c)
 //  + Log: 两步提交的日志系统 (log.c)
 //  + Inode Dir Path: 硬盘文件系统实现 (stat.h fs.h fs.c)
 //  + Pipe: 管道实现 (pipe.c)
@@ -27,64 +27,117 @@
 #include "sleeplock.h"
 #include "buf.h"
 #include "fs.h"
+#include "trace.h"
 
-// 缓存块链环 (LRU)
-// head.next是最近使用的
-// head.prev是最久未用的
+#define NBUCKET 13          // 缓存块哈希桶数
+#define BHASH(dev, blockno) (((dev) * 31 + (blockno)) % NBUCKET)
+#define BBUSY 0x80000000    // refcnt的最高位: 缓存块正在被替换 (持有bcache.lock)
+
+// 缓存块哈希表
+// 命中时不获取缓存锁: 沿哈希链查找, 原子地增加引用计数, 再确认块号
+// 未命中时持有bcache.lock, 替换引用为零且最久未用的缓存块
+// 替换期间refcnt为BBUSY, 无锁查找不会增加它的引用, 改为加锁查找
+// 缓存块数组是静态的, 因此无锁查找读到的总是一个缓存块
 struct {
-    struct spinlock lock; // 缓存锁
-    struct buf buf[NBUF]; // 缓存块数组
-    struct buf head;      // 缓存链环头结点
+    struct spinlock lock;       // 保护哈希链的修改和缓存块的替换
+    struct buf buf[NBUF];       // 缓存块数组
+    struct buf* hash[NBUCKET];  // 缓存块哈希链
 } bcache;
 
-// 初始化缓存链环
+// 初始化缓存块哈希表
 void binit(void)
 {
     initlock(&bcache.lock, "bcache");
 
-    // 初始化头结点自环
-    bcache.head.prev = &bcache.head;
-    bcache.head.next = &bcache.head;
-
-    // 插入所有缓存块到链环
-    // head-->buf[NBUF-1...0]-->head
+    // 未使用的缓存块都是(0, 0)块, 放在第0个哈希链中 (设备号从1开始, 不会被查找)
     for (struct buf* b = bcache.buf; b < bcache.buf + NBUF; b++) {
-        b->prev = &bcache.head;
-        b->next = bcache.head.next;
         initsleeplock(&b->lock, "buffer");
-        bcache.head.next->prev = b;
-        bcache.head.next = b;
+        b->next = bcache.hash[BHASH(0, 0)];
+        bcache.hash[BHASH(0, 0)] = b;
     }
 }
 
-// 从链环中获取缓存块
+// 缓存块没有在替换时原子地增加引用, 成功返回true
+static int bgetref(struct buf* b)
+{
+    uint ref = __atomic_load_n(&b->refcnt, __ATOMIC_RELAXED);
+    while ((ref & BBUSY) == 0)
+        if (__atomic_compare_exchange_n(&b->refcnt, &ref, ref + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return true;
+    return false;
+}
+
+// 减少缓存块的引用, 并记录使用时间
+static void bput(struct buf* b)
+{
+    b->lastuse = r_time();
+    __atomic_sub_fetch(&b->refcnt, 1, __ATOMIC_RELEASE);
+}
+
+// 从哈希表中获取缓存块 (增加引用)
 struct buf* bget(uint dev, uint blockno)
 {
     buf* b;
+    buf** head = &bcache.hash[BHASH(dev, blockno)];
+
+    // 无锁查找, 不写缓存锁
+    // 持有引用时缓存块不会被替换, 因此增加引用后再次确认块号
+    for (b = __atomic_load_n(head, __ATOMIC_ACQUIRE); b != NULL; b = __atomic_load_n(&b->next, __ATOMIC_ACQUIRE)) {
+        if (b->dev == dev && b->blockno == blockno) {
+            if (bgetref(b)) {
+                if (b->dev == dev && b->blockno == blockno)
+                    return b;
+                bput(b); // 已经被替换, 加锁查找
+            }
+            break;
+        }
+    }
 
     acquire(&bcache.lock); //* 获取缓存锁
 
-    // 遍历缓存链环 寻找对应缓存块
-    for (b = bcache.head.next; b != &bcache.head; b = b->next) {
+    // 持有锁时哈希链不会改变, 也没有正在替换的缓存块
+    for (b = *head; b != NULL; b = b->next) {
         if (b->dev == dev && b->blockno == blockno) {
-            b->refcnt++;           // 增加引用计数
-            release(&bcache.lock); //* 释放缓存锁
+            __atomic_add_fetch(&b->refcnt, 1, __ATOMIC_ACQUIRE); // 增加引用计数
+            release(&bcache.lock);                                //* 释放缓存锁
             return b;
         }
     }
 
-    // 如果没找到 则从尾部找闲置LRU缓存
-    for (b = bcache.head.prev; b != &bcache.head; b = b->prev) {
-        if (b->refcnt == 0) {
-            b->dev = dev;          // 设备号
-            b->blockno = blockno;  // 块号
-            b->valid = false;      // 无效位
-            b->refcnt = 1;         // 引用计数
-            release(&bcache.lock); //* 释放缓存锁
-            return b;
-        }
+    // 如果没找到, 则替换引用为零且最久未用的缓存块
+    // 无锁查找可能同时增加引用, 通过CAS将引用从0改为BBUSY后才能替换
+    for (;;) {
+        struct buf* victim = NULL;
+        for (b = bcache.buf; b < bcache.buf + NBUF; b++)
+            if (__atomic_load_n(&b->refcnt, __ATOMIC_RELAXED) == 0 && (victim == NULL || b->lastuse < victim->lastuse))
+                victim = b;
+        if (victim == NULL)
+            panic("bget: no buffers");
+
+        uint zero = 0;
+        b = victim;
+        if (__atomic_compare_exchange_n(&b->refcnt, &zero, BBUSY, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
     }
-    panic("bget: no buffers");
+
+    // 从原来的哈希链中移除
+    // 保留b->next, 正在遍历它的无锁查找仍能走完哈希链
+    buf** pp = &bcache.hash[BHASH(b->dev, b->blockno)];
+    while (*pp != b)
+        pp = &(*pp)->next;
+    *pp = b->next;
+
+    b->dev = dev;         // 设备号
+    b->blockno = blockno; // 块号
+    b->valid = false;     // 无效位
+
+    // 插入新的哈希链头部, 最后设置引用计数, 清除BBUSY
+    b->next = *head;
+    __atomic_store_n(head, b, __ATOMIC_RELEASE);
+    __atomic_store_n(&b->refcnt, 1, __ATOMIC_RELEASE);
+
+    release(&bcache.lock); //* 释放缓存锁
+    return b;
 }
 
 // 锁定硬盘块到缓存
@@ -92,6 +145,7 @@ buf* bread(uint dev, uint blockno)
 {
     buf* b = bget(dev, blockno);
     acquiresleep(&b->lock); //* 获取块锁
+    TRACEPOINT(TR_BREAD, blockno, b->valid);
 
     // 如果块无效 则读取数据
     if (!b->valid) {
@@ -108,6 +162,7 @@ void bwrite(struct buf* b)
     // 确保当前进程持有块锁
     if (holdingsleep(&b->lock) == false)
         panic("bwrite");
+    TRACEPOINT(TR_BWRITE, b->blockno, 0);
     virtio_disk_rw(b, true);
 }
 
@@ -120,36 +175,12 @@ void brelse(struct buf* b)
 
     releasesleep(&b->lock); //** 释放块锁 (唤醒)
 
-    acquire(&bcache.lock); //* 获取缓存锁
-
-    // 减少引用计数
-    b->refcnt--;
-
-    // 如果引用清零, 则将缓存块移到队首
-    if (b->refcnt == 0) {
-        b->next->prev = b->prev;
-        b->prev->next = b->next;
-        b->next = bcache.head.next;
-        b->prev = &bcache.head;
-        bcache.head.next->prev = b;
-        bcache.head.next = b;
-    }
-
-    release(&bcache.lock); //* 释放缓存锁
+    // 减少引用计数, 引用清零的缓存块可以被替换, 按lastuse选择最久未用的
+    bput(b);
 }
 
-// 增加缓存链块的引用
-void bpin(struct buf* b)
-{
-    acquire(&bcache.lock); //* 获取缓存锁
-    b->refcnt++;
-    release(&bcache.lock); //* 释放缓存锁
-}
+// 增加缓存块的引用 (调用者已持有引用, 不需要缓存锁)
+void bpin(struct buf* b) { __atomic_add_fetch(&b->refcnt, 1, __ATOMIC_RELAXED); }
 
-// 减少缓存链块的引用
-void bunpin(struct buf* b)
-{
-    acquire(&bcache.lock); //* 获取缓存锁
-    b->refcnt--;
-    release(&bcache.lock); //* 释放缓存锁
-}
+// 减少缓存块的引用
+void bunpin(struct buf* b) { bput(b); }
@@ -4,11 +4,11 @@ typedef struct buf {
     int valid;      // 数据是否有效
     uint dev;       // 设备号
     uint blockno;   // 硬盘块号
-    uint refcnt;    // 引用计数
+    uint refcnt;    // 引用计数 (原子操作, 最高位为BBUSY)
     uint disk;      // virtio是否正在处理
     sleeplock lock; // 同步睡眠锁
 
-    struct buf* prev;  // 链环中的前块
-    struct buf* next;  // 链环中的后块
+    struct buf* next;  // 哈希链中的后块 (无锁查找沿此遍历)
+    uint64 lastuse;    // 最后一次释放引用的time寄存器值 (替换最久未用的块)
     uchar data[BSIZE]; // 缓冲链块数据
 } buf;
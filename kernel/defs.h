@@ -2,6 +2,7 @@
 struct buf;
 struct context;
 struct file;
+struct kmem_cache;
 struct minode;
 struct pipe;
 struct proc;
@@ -73,11 +74,42 @@ void            ramdiskinit(void);
 void            ramdiskintr(void);
 void            ramdiskrw(struct buf*);
 
+// -------------------------------- futex.c --------------------------------
+
+void            futexinit(void);
+int             futexwait(uint64, int);
+int             futexwake(uint64, int);
+
 // -------------------------------- kalloc.c --------------------------------
 
 void*           kalloc(void);
 void            kfree(void *);
+void*           kalloc_zeroed(void);
+int             kzero_idle(void);
+void*           kalloc_pages(int order);
+void            kfree_pages(void* pa, int order);
+void            krefinc(void* pa);
+int             krefcnt(void* pa);
 void            kinit(void);
+void            kallocdump(void);
+
+// -------------------------------- slab.c --------------------------------
+
+struct kmem_cache* kmem_cache_create(char* name, uint size);
+void*           kmem_cache_alloc(struct kmem_cache* c);
+void            kmem_cache_free(struct kmem_cache* c, void* obj);
+int             kmem_cache_reap(void);
+void            slabdump(void);
+
+// -------------------------------- mmap.c --------------------------------
+
+uint64          mmap(uint64, uint64, int, int, struct file*, uint64);
+int             munmap(uint64, uint64);
+void            munmapall(struct proc*);
+int             mmapfault(struct proc*, uint64, int, int);
+void            mmapprefault(uint64, uint64, int);
+int             mmapfork(struct proc*, struct proc*);
+int             mmapshared(struct proc*, uint64);
 
 // -------------------------------- log.c --------------------------------
 
@@ -88,6 +120,7 @@ void            end_op(void);
 
 // -------------------------------- pipe.c --------------------------------
 
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -104,23 +137,30 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
-int             growproc(int);
-void            proc_mapstacks(pagetable_t);
-pagetable_t     proc_pagetable(struct proc *);
-void            proc_freepagetable(pagetable_t, uint64);
+int             clone(uint64, uint64, uint64);
+int             join(int, uint64);
+uint64          growproc(int);
+pagetable_t     proc_pagetable(void);
+void            proc_freepagetable(pagetable_t, uint64, uint64);
 int             kill(int);
 int             killed(struct proc*);
 void            setkilled(struct proc*);
+int             setnice(int, int);
+int             getnice(int, int*);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
 void            procinit(void);
 void            scheduler(void) __attribute__((noreturn));
+void            runqput(struct proc*);
 void            sched(void);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
+int             waitpid(int, uint64, int);
 void            wakeup(void*);
+void            wakeone(void*);
+int             wakeupn(void*, int);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
@@ -138,6 +178,7 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+void            lockdump(void);
 
 // -------------------------------- sleeplock.c --------------------------------
 
@@ -165,12 +206,44 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// -------------------------------- timer.c --------------------------------
+
+void            wheelinit(void);
+int             timerrun(void);
+uint64          timernext(void);
+int             timersleep(uint64);
+void            timerdump(void);
+
+// -------------------------------- prof.c --------------------------------
+
+void            profinit(void);
+void            proftick(void);
+uint64          profnext(void);
+void            profdump(void);
+
+// -------------------------------- trace.c --------------------------------
+
+extern uint     tracemask;
+void            traceinit(void);
+void            tracerec(int, uint64, uint64);
+void            tracedump(void);
+
+// 记录内核事件 (trace.h), 类别未开启时只有一次判断
+#define TRACEPOINT(ev, a0, a1)                                              \
+    do {                                                                    \
+        if (tracemask & (1 << ((ev) >> 4)))                                 \
+            tracerec((ev), (uint64)(a0), (uint64)(a1));                     \
+    } while (0)
+
 // -------------------------------- trap.c --------------------------------
 
 extern uint     ticks;
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
+extern uint64   boottime;
+void            ticksync(void);
+void            timerset(int);
 void            usertrapret(void);
 
 // -------------------------------- uart.c --------------------------------
@@ -184,6 +257,17 @@ void            uartputc_sync(int);
 
 void            kvminit(void);
 void            kvminithart(void);
+void            asidinit(void);
+int             kvmmapstack(uint64, uint64);
+void            kvmswitch(struct proc*);
+uint64          uvmsatp(struct proc*);
+void            uvmflush(pagetable_t, uint64);
+void            tlbsync(void);
+void            tlbdump(void);
+pagetable_t     kvmcreate(pagetable_t);
+void            kvmuwin(pagetable_t, pagetable_t);
+int             uwinfault(uint64, int);
+uint64          ucopyfixup(uint64);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
@@ -191,8 +275,12 @@ void            uvmfirst(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmshare(pagetable_t, pagetable_t, uint64, uint64, int);
+int             uvmcow(pagetable_t, uint64);
+int             vmfault(pagetable_t, uint64, int, int);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
+int             uvmdetach(pagetable_t, uint64);
 void            uvmclear(pagetable_t, uint64);
 pte_t *         walk(pagetable_t pagetable, uint64 va, int alloc);
 uint64          walkaddr(pagetable_t pagetable, uint64 va);
@@ -20,11 +20,16 @@ int flags2perm(int flags)
 }
 
 // sysfile.c->sys_exec 跳转到这里
+// 地址空间被其他线程共享时 (包括尚未回收的线程) 不能替换, 返回-1
 // int exec(char *file, char *argv[])
 int exec(char* path, char** argv)
 {
     uint64 sz = 0, sp, stackbase;
     pagetable_t pagetable = NULL;
+    struct proc* p = myproc();
+
+    if (p->mm->ref > 1)
+        return -1;
 
     begin_op(); //* 事务开始
 
@@ -44,10 +49,14 @@ int exec(char* path, char** argv)
     if (elf.magic != ELF_MAGIC)
         goto bad;
 
-    // 创建一个新的用户页表
-    struct proc* p = myproc();
-    if ((pagetable = proc_pagetable(p)) == 0)
+    // 创建一个新的用户页表, 并将trapframe数据页映射到原来的槽位
+    if ((pagetable = proc_pagetable()) == 0)
         goto bad;
+    if (mappages(pagetable, p->trapva, PGSIZE, (uint64)p->trapframe, PTE_R | PTE_W) < 0) {
+        proc_freepagetable(pagetable, 0, 0);
+        pagetable = NULL;
+        goto bad;
+    }
 
     // 加载用户程序到内存
     struct proghdr ph;
@@ -83,8 +92,7 @@ int exec(char* path, char** argv)
 
     end_op(); //* 事务结束
 
-    p = myproc();
-    uint64 oldsz = p->sz;
+    uint64 oldsz = p->mm->sz;
 
     // 在下一页边界分配一些页
     // 将第一个页设置为不可访问作为栈保护
@@ -141,14 +149,20 @@ int exec(char* path, char** argv)
             last = s + 1;
     safestrcpy(p->name, last, sizeof(p->name));
 
+    // 移除旧程序的内存映射
+    munmapall(p);
+
     // 切换到新的页表
     pagetable_t oldpagetable = p->pagetable;
     p->pagetable = pagetable;
+    p->mm->pagetable = pagetable;
+    kvmuwin(p->kpagetable, pagetable); // 用户窗口指向新的页表
+    uvmflush(pagetable, -1);           // 刷新进程的所有TLB项 (只针对进程的ASID)
 
-    p->sz = sz;                              // 更新用户内存大小
-    p->trapframe->epc = elf.entry;           // 设置程序入口地址
-    p->trapframe->sp = sp;                   // 设置用户栈指针
-    proc_freepagetable(oldpagetable, oldsz); // 清空旧页表
+    p->mm->sz = sz;                                     // 更新用户内存大小
+    p->trapframe->epc = elf.entry;                      // 设置程序入口地址
+    p->trapframe->sp = sp;                              // 设置用户栈指针
+    proc_freepagetable(oldpagetable, p->trapva, oldsz); // 清空旧页表
 
     // 返回后会将argc保存到a0寄存器
     // 即main(argc, argv)的第一个参数
@@ -156,7 +170,7 @@ int exec(char* path, char** argv)
 
 bad:
     if (pagetable)
-        proc_freepagetable(pagetable, sz);
+        proc_freepagetable(pagetable, p->trapva, sz);
     if (mip) {
         iunlockput(mip);
         end_op(); //* 事务结束
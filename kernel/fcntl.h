@@ -5,3 +5,16 @@
 #define O_RDWR 0x002    // 读写
 #define O_CREATE 0x200  // 创建
 #define O_TRUNC 0x400   // 截断
+
+// void* mmap(void* addr, uint64 len, int prot, int flags, int fd, uint64 off)
+#define PROT_READ 0x1       // 可读
+#define PROT_WRITE 0x2      // 可写
+#define PROT_EXEC 0x4       // 可执行
+#define MAP_SHARED 0x01     // 共享映射, 修改写回文件
+#define MAP_PRIVATE 0x02    // 私有映射, 写时复制
+#define MAP_ANONYMOUS 0x20  // 匿名映射, 不关联文件
+#define MAP_HUGETLB 0x40000 // 使用2MB大页 (仅限匿名映射)
+#define MAP_FAILED ((void*)-1)
+
+// int waitpid(int pid, int* status, int options)
+#define WNOHANG 0x1 // 子进程都没有退出时立即返回0
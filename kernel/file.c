@@ -4,7 +4,7 @@
 //  -------------------------------------------------
 //  + FS.img: 文件系统映像 (mkfs.c)
 //  + VirtIO: 虚拟硬盘驱动 (virtio.h virtio_disk.c)
-//  + BCache: LRU缓存链环 (buf.h bio.c)
+//  + BCache: LRU缓存哈希表 (buf.h bio.c)
 //  + Log: 两步提交的日志系统 (log.c)
 //  + Inode Dir Path: 硬盘文件系统实现 (stat.h fs.h fs.c)
 //  + Pipe: 管道实现 (pipe.c)
@@ -31,27 +31,29 @@ struct devsw devsw[NDEV];
 
 // 文件描述符表
 struct {
-    spinlock lock;
-    file file[NFILE];
+    spinlock lock;            // 保护引用计数
+    struct kmem_cache* cache; // 描述符对象缓存
 } ftable;
 
-void fileinit(void) { initlock(&ftable.lock, "ftable"); }
+void fileinit(void)
+{
+    initlock(&ftable.lock, "ftable");
+    ftable.cache = kmem_cache_create("file", sizeof(file));
+}
 
 // ----------------------------------------------------------------
 
-// 分配空闲描述符
+// 分配空闲描述符, 内存耗尽时返回NULL
 file* filealloc(void)
 {
-    acquire(&ftable.lock); //* 获取描述符表锁
-    for (file* f = ftable.file; f < ftable.file + NFILE; f++) {
-        if (f->ref == 0) {
-            f->ref = 1;
-            release(&ftable.lock); //* 释放描述符表锁
-            return f;
-        }
-    }
+    file* f = kmem_cache_alloc(ftable.cache);
+    if (f == NULL)
+        return NULL;
 
-    panic("filealloc");
+    memset(f, 0, sizeof(*f));
+    f->type = FD_NONE;
+    f->ref = 1;
+    return f;
 }
 
 // ----------------------------------------------------------------
@@ -91,6 +93,8 @@ void fileclose(file* f)
     f->type = FD_NONE;
     release(&ftable.lock); //* 释放描述符表锁
 
+    kmem_cache_free(ftable.cache, f); // 释放描述符对象
+
     // 如果是管道, 则关闭
     if (ff.type == FD_PIPE) {
         pipeclose(ff.pipe, ff.writable);
@@ -136,6 +140,9 @@ int fileread(file* f, uint64 addr, int n)
     if (f->readable == false)
         return -1;
 
+    // 预先读入用户缓冲区中尚未映射的文件映射页
+    mmapprefault(addr, n, true);
+
     int r = 0;
     switch (f->type) {
         case FD_PIPE:
@@ -176,6 +183,9 @@ int filewrite(file* f, uint64 addr, int n)
     if (f->writable == false)
         return -1;
 
+    // 预先读入用户缓冲区中尚未映射的文件映射页
+    mmapprefault(addr, n, false);
+
     int ret = 0;
     switch (f->type) {
         case FD_PIPE:
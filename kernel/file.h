@@ -4,7 +4,7 @@
 //  -------------------------------------------------
 //  + FS.img: 文件系统映像 (mkfs.c)
 //  + VirtIO: 虚拟硬盘驱动 (virtio.h virtio_disk.c)
-//  + BCache: LRU缓存链环 (buf.h bio.c)
+//  + BCache: LRU缓存哈希表 (buf.h bio.c)
 //  + Log: 两步提交的日志系统 (log.c)
 //  + Inode Dir Path: 硬盘文件系统实现 (stat.h fs.h fs.c)
 //  + Pipe: 管道实现 (pipe.c)
@@ -49,6 +49,10 @@ typedef struct minode {
     short nlink;             // 硬链接数
     uint size;               // 文件大小 (字节)
     uint addrs[NDIRECT + 1]; // 文件块号 (直接块+间接引导块)
+
+    struct minode* next;     // 内存-索引表哈希链中的后项 (无锁查找沿此遍历)
+    struct minode* prev;     // 内存-索引表哈希链中的前项
+    struct minode* freenext; // 空闲链表中的后项
 } minode;
 
 // 终端设备
@@ -61,3 +65,5 @@ extern struct devsw devsw[];
 
 // 终端的主设备号 (1)
 #define CONSOLE 1
+#define PROF 2 // 采样分析器 (prof.c)
+#define TRACE 3 // 内核事件跟踪 (trace.c)
@@ -4,7 +4,7 @@
 //  -------------------------------------------------
 //  + FS.img: 文件系统映像 (mkfs.c)
 //  + VirtIO: 虚拟硬盘驱动 (virtio.h virtio_disk.c)
-//  + BCache: LRU缓存链环 (buf.h bio.c)
+//  + BCache: LRU缓存哈希表 (buf.h bio.c)
 //  + Log: 两步提交的日志系统 (log.c)
 //  + Inode Dir Path: 硬盘文件系统实现 (stat.h fs.h fs.c)
 //  + Pipe: 管道实现 (pipe.c)
@@ -105,17 +105,25 @@ static void bfree(uint dev, uint bno)
 
 // -------------------------------- Inode -------------------------------- //
 
+#define NINODEHASH 61 // 内存-索引表的哈希桶数
+#define IHASH(dev, inum) (((dev) * 31 + (inum)) % NINODEHASH)
+
 // 内存-索引表
+// 按(dev, inum)散列, 只包含引用计数大于零的索引项
+// 命中时不获取索引表锁 (iget), 只有插入和移除索引项时持有itable.lock
+// 引用清零的索引项放入空闲链表, 不归还slab (类型稳定)
+// 因此无锁查找读到的总是一个索引项, 增加引用之后再确认它仍是要找的项
 struct {
-    spinlock lock;        // 索引表锁
-    minode inode[NINODE]; // 内存-索引项数组
+    spinlock lock;            // 保护哈希链和空闲链表的修改
+    minode* hash[NINODEHASH]; // 索引项哈希链
+    minode* free;             // 空闲链表
+    struct kmem_cache* cache; // 索引项对象缓存
 } itable;
 
 void iinit()
 {
     initlock(&itable.lock, "itable");
-    for (int i = 0; i < NINODE; i++)
-        initsleeplock(&itable.inode[i].lock, "inode");
+    itable.cache = kmem_cache_create("inode", sizeof(minode));
 }
 
 // ----------------------------------------------------------------
@@ -150,34 +158,64 @@ minode* ialloc(uint dev, short type)
     panic("ialloc: no inodes");
 }
 
+// 引用计数非零时原子地增加引用, 成功返回true
+// 引用为零的索引项正在被移除, 或者已经在空闲链表中
+static int igetref(minode* mip)
+{
+    int ref = __atomic_load_n(&mip->ref, __ATOMIC_RELAXED);
+    while (ref > 0)
+        if (__atomic_compare_exchange_n(&mip->ref, &ref, ref + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return true;
+    return false;
+}
+
 // 索引项条目: 硬盘=>内存 (暂时不加载数据 增加引用)
 static minode* iget(uint dev, uint inum)
 {
-    minode *mip, *empty = NULL;
+    minode* mip;
+    minode** head = &itable.hash[IHASH(dev, inum)];
+
+    // 无锁查找, 不写索引表锁
+    // 遍历期间索引项可能被移除并重新使用, 因此增加引用后再次确认(dev, inum)
+    for (mip = __atomic_load_n(head, __ATOMIC_ACQUIRE); mip != NULL; mip = __atomic_load_n(&mip->next, __ATOMIC_ACQUIRE)) {
+        if (mip->dev == dev && mip->inum == inum && igetref(mip)) {
+            if (mip->dev == dev && mip->inum == inum)
+                return mip;
+            iput(mip); // 已经被重新使用, 加锁查找
+            break;
+        }
+    }
+
     acquire(&itable.lock); //* 获取索引表锁
 
-    // 遍历内存-索引表 寻找对应索引项
-    for (mip = &itable.inode[0]; mip < &itable.inode[NINODE]; mip++) {
-        // 如果索引项已在内存, 则增加引用计数
-        if (mip->ref > 0 && mip->dev == dev && mip->inum == inum) {
-            mip->ref++;            // 增加引用计数
-            release(&itable.lock); //* 释放索引表锁
+    // 持有锁时哈希链不会改变, 其中的索引项引用都大于零
+    for (mip = *head; mip != NULL; mip = mip->next) {
+        if (mip->dev == dev && mip->inum == inum) {
+            __atomic_add_fetch(&mip->ref, 1, __ATOMIC_RELAXED); // 增加引用计数
+            release(&itable.lock);                              //* 释放索引表锁
             return mip;
         }
-
-        // 记录空闲索引项
-        if (empty == NULL && mip->ref == 0)
-            empty = mip;
     }
 
-    if (empty == NULL)
+    // 从空闲链表或缓存分配新的索引项
+    if ((mip = itable.free) != NULL)
+        itable.free = mip->freenext;
+    else if ((mip = kmem_cache_alloc(itable.cache)) == NULL)
         panic("iget: no inodes");
 
-    mip = empty;        // 空闲索引项
+    // 引用为零时无锁查找不会使用它, 初始化完成后再设置引用计数
+    initsleeplock(&mip->lock, "inode");
     mip->dev = dev;     // 设备号
     mip->inum = inum;   // 索引编号
-    mip->ref = 1;       // 引用计数
     mip->valid = false; // 有效位
+    __atomic_store_n(&mip->ref, 1, __ATOMIC_RELEASE);
+
+    // 插入哈希链头部
+    mip->prev = NULL;
+    mip->next = *head;
+    if (*head != NULL)
+        (*head)->prev = mip;
+    __atomic_store_n(head, mip, __ATOMIC_RELEASE);
 
     release(&itable.lock); //* 释放索引表锁
     return mip;
@@ -243,18 +281,22 @@ void iunlock(minode* mip)
 
 // ----------------------------------------------------------------
 
-// 增加内存-索引项的引用计数
+// 增加内存-索引项的引用计数 (调用者已持有引用, 不需要索引表锁)
 minode* idup(minode* mip)
 {
-    acquire(&itable.lock); //* 获取索引表锁
-    mip->ref++;
-    release(&itable.lock); //* 释放索引表锁
+    __atomic_add_fetch(&mip->ref, 1, __ATOMIC_RELAXED);
     return mip;
 }
 
 // 减少内存-索引项的引用计数
 void iput(minode* mip)
 {
+    // 不是最后一个引用时直接减少, 不获取索引表锁
+    int ref = __atomic_load_n(&mip->ref, __ATOMIC_RELAXED);
+    while (ref > 1)
+        if (__atomic_compare_exchange_n(&mip->ref, &ref, ref - 1, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            return;
+
     acquire(&itable.lock); //* 获取索引表锁
 
     // 释放最后一个引用, 并且没有硬链接
@@ -272,7 +314,21 @@ void iput(minode* mip)
         acquire(&itable.lock);    //* 获取索引表锁
     }
 
-    mip->ref--;            // 减少引用计数
+    // 减少引用计数, 无锁查找可能同时增加引用, 因此使用原子操作
+    // 引用清零, 从哈希链移除并放入空闲链表
+    // 保留mip->next, 正在遍历它的无锁查找仍能走完哈希链
+    if (__atomic_sub_fetch(&mip->ref, 1, __ATOMIC_ACQ_REL) == 0) {
+        if (mip->prev != NULL)
+            mip->prev->next = mip->next;
+        else
+            itable.hash[IHASH(mip->dev, mip->inum)] = mip->next;
+        if (mip->next != NULL)
+            mip->next->prev = mip->prev;
+
+        mip->freenext = itable.free;
+        itable.free = mip;
+    }
+
     release(&itable.lock); //* 释放索引表锁
 }
 
@@ -555,8 +611,13 @@ static minode* namex(char* path, int parent, char* name)
     minode* mip;
     if (*path == '/')
         mip = iget(ROOTDEV, ROOTINO); // 绝对路径 (加引用)
-    else
-        mip = idup(myproc()->cwd); // 相对路径 (加引用)
+    else {
+        // 相对路径 (加引用), 同一进程的其他线程可能同时chdir
+        struct fdtable* fdt = myproc()->fdt;
+        acquire(&fdt->lock);
+        mip = idup(fdt->cwd);
+        release(&fdt->lock);
+    }
 
     // 逐级查找路径经过的目录
     while ((path = skipelem(path, name)) != NULL) {
@@ -4,7 +4,7 @@
 //  -------------------------------------------------
 //  + FS.img: 文件系统映像 (mkfs.c)
 //  + VirtIO: 虚拟硬盘驱动 (virtio.h virtio_disk.c)
-//  + BCache: LRU缓存链环 (buf.h bio.c)
+//  + BCache: LRU缓存哈希表 (buf.h bio.c)
 //  + Log: 两步提交的日志系统 (log.c)
 //  + Inode Dir Path: 硬盘文件系统实现 (stat.h fs.h fs.c)
 //  + Pipe: 管道实现 (pipe.c)
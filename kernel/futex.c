@@ -0,0 +1,120 @@
+// futex: 用户空间同步原语的内核部分
+//
+// 共享映射(MAP_SHARED)中的用户字以物理地址为键, 映射同一物理页的进程之间也能互相唤醒
+// 其他私有内存以(地址空间, 虚拟地址)为键: fork会把私有页重新标记为写时复制页,
+// 之后的写入会换成新的物理页, 以物理地址为键的等待者将无法被唤醒
+// 等待者持有键所在的锁桶检查值, 然后在proc.c的哈希休眠队列上休眠
+// 唤醒者修改值之后持有同一个锁桶唤醒, 因此不会丢失唤醒
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NFUTEX 64 // 锁桶数
+
+// 私有键的编码: 最高位为1, mm在直接映射内存中的8字节偏移(24位), 4字节对齐的虚拟地址(36位)
+// 物理地址小于PHYSTOP, 最高位为0, 不会与私有键相同
+#define FUTEX_PRIVATE (1UL << 63)
+#define FUTEX_MMSHIFT 36
+
+struct spinlock futexlocks[NFUTEX];
+
+void futexinit(void)
+{
+    // 私有键中的mm偏移不能进入最高位
+    if ((PHYSTOP - KERNBASE) / 8 > (1UL << (63 - FUTEX_MMSHIFT)))
+        panic("futexinit: key");
+    for (int i = 0; i < NFUTEX; i++)
+        initlock(&futexlocks[i], "futex");
+}
+
+static struct spinlock* futexlock(uint64 key) { return &futexlocks[((key >> 2) ^ (key >> 12)) % NFUTEX]; }
+
+// 处理用户地址va的延迟分配和写时复制, 成功返回0
+static int futexfault(pagetable_t pagetable, uint64 va)
+{
+    pte_t* pte = walk(pagetable, va, false);
+    if (pte == 0 || (*pte & (PTE_V | PTE_U | PTE_W)) != (PTE_V | PTE_U | PTE_W) || (*pte & PTE_COW)) {
+        // 只读映射上也可以等待
+        if (vmfault(pagetable, va, true, true) < 0 && vmfault(pagetable, va, false, true) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+// 返回用户地址va的futex键 (sleep的chan), 失败返回0
+static uint64 futexkey(struct proc* p, uint64 va)
+{
+    if (va % sizeof(int) != 0 || va >= MAXVA || futexfault(p->pagetable, va) < 0)
+        return 0;
+
+    acquire(&p->mm->lock);
+    int shared = mmapshared(p, va);
+    uint64 pa = walkaddr(p->pagetable, va);
+    release(&p->mm->lock);
+    if (pa == 0)
+        return 0;
+
+    if (shared)
+        return pa + (va & (PGSIZE - 1));
+    return FUTEX_PRIVATE | ((((uint64)p->mm - KERNBASE) / 8) << FUTEX_MMSHIFT) | (va >> 2);
+}
+
+// 读取用户字*va (持有futex锁桶), 失败返回-1
+// 持有mm->lock读取当前映射的物理页, 其他线程的写时复制不会使等待者读到旧页
+static int futexread(struct proc* p, uint64 va, int* val)
+{
+    acquire(&p->mm->lock);
+    uint64 pa = walkaddr(p->pagetable, va);
+    if (pa != 0)
+        *val = *(volatile int*)(pa + (va & (PGSIZE - 1)));
+    release(&p->mm->lock);
+    return pa != 0 ? 0 : -1;
+}
+
+// 如果用户字*va仍等于val, 则休眠直到futexwake
+// 被唤醒返回0, 值不相等或进程被终止返回-1
+// 调用者需要重新检查条件 (可能被其他原因唤醒)
+int futexwait(uint64 va, int val)
+{
+    struct proc* p = myproc();
+    uint64 key = futexkey(p, va);
+    if (key == 0)
+        return -1;
+
+    struct spinlock* lk = futexlock(key);
+    acquire(lk);
+
+    // 值已经改变, 说明唤醒者已经(或即将)唤醒
+    int cur;
+    if (futexread(p, va, &cur) < 0 || cur != val) {
+        release(lk);
+        return -1;
+    }
+    sleep((void*)key, lk);
+
+    int r = killed(p) ? -1 : 0;
+    release(lk);
+    return r;
+}
+
+// 唤醒至多n个在用户字va上等待的进程, 返回唤醒的进程数
+int futexwake(uint64 va, int n)
+{
+    struct proc* p = myproc();
+    uint64 key = futexkey(p, va);
+    if (key == 0)
+        return -1;
+    if (n <= 0)
+        return 0;
+
+    struct spinlock* lk = futexlock(key);
+    acquire(lk);
+    int woken = wakeupn((void*)key, n);
+    release(lk);
+    return woken;
+}
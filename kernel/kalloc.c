@@ -1,7 +1,16 @@
-
-// 简易物理内存分配器
+// 物理内存分配器
 // 用于用户进程, 内核栈, 页表, 管道缓冲区
-// 直接分配整个4096字节页
+//
+// 全局空闲内存由伙伴系统管理, 以 2^order 个连续页为单位分配, 释放时与伙伴块合并
+// kalloc_pages/kfree_pages 直接操作伙伴系统, 用于需要物理连续内存的场合
+//
+// 每个CPU持有一个单页缓存, kalloc/kfree 通常只访问本地缓存
+// 本地缓存为空时, 从伙伴系统批量补充 KBATCH 页, 伙伴系统也为空时从其他CPU窃取
+// 本地缓存超过 KCPUMAX 页时, 批量归还 KBATCH 页到伙伴系统
+//
+// 每个CPU还持有一个预清零页池, 由空闲的调度器通过kzero_idle填充
+// kalloc_zeroed 优先从本地预清零池分配, 避免在分配路径上清零整页
+// 定义KJUNK时, kalloc/kfree 用垃圾填充页面以捕获悬空引用 (make KJUNK=1)
 
 #include "types.h"
 #include "param.h"
@@ -10,31 +19,313 @@
 #include "riscv.h"
 #include "defs.h"
 
+#define MAXORDER 10          // 伙伴系统的最大阶数 (2^10页 = 4MB)
+#define KBATCH 32            // 本地缓存与伙伴系统之间单次交换的页数
+#define KCPUMAX (KBATCH * 2) // 本地缓存的最大页数
+#define KZEROMAX 32          // 每个CPU预清零池的最大页数
+
+#define NPAGES ((PHYSTOP - KERNBASE) / PGSIZE)        // 物理页总数
+#define PA2IDX(pa) (((uint64)(pa) - KERNBASE) / PGSIZE) // 物理地址 => 页编号
+#define IDX2PA(i) (KERNBASE + (uint64)(i) * PGSIZE)     // 页编号 => 物理地址
+
 void freerange(void* pa_start, void* pa_end);
 
 // kernel程序的结束地址 (kernel.ld)
 extern char end[];
 
+// 空闲块头部 (存放在空闲页内)
+// 伙伴系统使用双向链表, 本地缓存只使用next
 struct run {
     struct run* next;
+    struct run* prev;
+};
+
+// 每个物理页的描述信息
+struct page {
+    char free;  // 是否为伙伴系统中空闲块的首页
+    char order; // 所在块的阶数
+    int ref;    // 已分配块的引用计数 (记录在块的首页, 用于写时复制)
+};
+
+static struct page pages[NPAGES];
+
+// 每个CPU的空闲页缓存
+struct kcpu {
+    struct spinlock lock; // 只有被其他CPU窃取时才会发生竞争
+    struct run* freelist; // 本地空闲链表
+    int nfree;            // 本地空闲页数
+
+    uint64 hit;   // 直接从本地缓存分配的次数
+    uint64 miss;  // 从伙伴系统批量补充的次数
+    uint64 steal; // 从其他CPU窃取的次数
+
+    struct run* zlist; // 预清零页链表
+    int nzero;         // 预清零页数
+    uint64 zhit;       // kalloc_zeroed 命中预清零池的次数
+    uint64 zmiss;      // kalloc_zeroed 未命中预清零池的次数
 };
 
 struct {
-    struct spinlock lock;
-    struct run* freelist;
+    struct spinlock lock;           // 伙伴系统锁
+    struct run area[MAXORDER + 1];  // 每阶空闲块链环的头结点
+    int nfree[MAXORDER + 1];        // 每阶空闲块数
+    struct kcpu cpu[NCPU];
 } kmem;
 
 void kinit()
 {
-    initlock(&kmem.lock, "kmem");   // 初始化kmem锁
-    freerange(end, (void*)PHYSTOP); // 释放所有堆页到空闲链表
+    initlock(&kmem.lock, "kmem"); // 初始化kmem锁
+    for (int k = 0; k <= MAXORDER; k++) {
+        kmem.area[k].next = &kmem.area[k];
+        kmem.area[k].prev = &kmem.area[k];
+    }
+    for (int i = 0; i < NCPU; i++)
+        initlock(&kmem.cpu[i].lock, "kmem_cpu");
+    freerange(end, (void*)PHYSTOP); // 释放所有堆页到伙伴系统
 }
 
+// 将[pa_start, pa_end)按最大的对齐块释放到伙伴系统
 void freerange(void* pa_start, void* pa_end)
 {
     char* p = (char*)PGROUNDUP((uint64)pa_start); // 对齐PGSIZE
-    for (; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-        kfree(p); // 释放到空闲链表
+    while (p + PGSIZE <= (char*)pa_end) {
+        int order = 0;
+        while (order < MAXORDER && PA2IDX(p) % (2 << order) == 0
+            && p + (PGSIZE << (order + 1)) <= (char*)pa_end)
+            order++;
+        pages[PA2IDX(p)].ref = 1; // kfree_pages会减少引用计数
+        kfree_pages(p, order);    // 释放到伙伴系统
+        p += PGSIZE << order;
+    }
+}
+
+// -------------------------------- Refcount -------------------------------- //
+
+// 增加物理页的引用计数 (写时复制共享)
+void krefinc(void* pa)
+{
+    if (((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+        panic("krefinc");
+    __sync_fetch_and_add(&pages[PA2IDX(pa)].ref, 1);
+}
+
+// 减少物理页的引用计数, 返回剩余的引用数
+static int krefdec(void* pa)
+{
+    int ref = __sync_sub_and_fetch(&pages[PA2IDX(pa)].ref, 1);
+    if (ref < 0)
+        panic("krefdec");
+    return ref;
+}
+
+// 返回物理页的引用计数
+int krefcnt(void* pa)
+{
+    if (((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+        panic("krefcnt");
+    return __atomic_load_n(&pages[PA2IDX(pa)].ref, __ATOMIC_SEQ_CST);
+}
+
+// -------------------------------- Buddy -------------------------------- //
+
+static void area_insert(uint64 idx, int order)
+{
+    struct run* r = (struct run*)IDX2PA(idx);
+    struct run* head = &kmem.area[order];
+
+    r->next = head->next;
+    r->prev = head;
+    head->next->prev = r;
+    head->next = r;
+
+    pages[idx].free = true;
+    pages[idx].order = order;
+    kmem.nfree[order]++;
+}
+
+static void area_remove(uint64 idx, int order)
+{
+    struct run* r = (struct run*)IDX2PA(idx);
+
+    r->prev->next = r->next;
+    r->next->prev = r->prev;
+
+    pages[idx].free = false;
+    kmem.nfree[order]--;
+}
+
+// 从伙伴系统分配 2^order 个连续页 (需持有kmem.lock)
+static void* buddy_alloc(int order)
+{
+    int k = order;
+    while (k <= MAXORDER && kmem.area[k].next == &kmem.area[k])
+        k++;
+    if (k > MAXORDER)
+        return NULL;
+
+    uint64 idx = PA2IDX(kmem.area[k].next);
+    area_remove(idx, k);
+
+    // 逐级分裂, 将后半块放回低一阶的链表
+    while (k > order) {
+        k--;
+        area_insert(idx + (1 << k), k);
+    }
+
+    pages[idx].order = order;
+    return (void*)IDX2PA(idx);
+}
+
+// 释放 2^order 个连续页到伙伴系统, 并与空闲伙伴合并 (需持有kmem.lock)
+static void buddy_free(void* pa, int order)
+{
+    uint64 idx = PA2IDX(pa);
+
+    while (order < MAXORDER) {
+        uint64 buddy = idx ^ (1 << order);
+        if (buddy >= NPAGES || IDX2PA(buddy) < (uint64)end)
+            break;
+        if (pages[buddy].free == false || pages[buddy].order != order)
+            break;
+
+        area_remove(buddy, order);
+        if (buddy < idx)
+            idx = buddy;
+        order++;
+    }
+
+    area_insert(idx, order);
+}
+
+// 分配 2^order 个物理连续页, 首地址按块大小对齐
+void* kalloc_pages(int order)
+{
+    if (order < 0 || order > MAXORDER)
+        return NULL;
+    if (order == 0)
+        return kalloc();
+
+    acquire(&kmem.lock); //* 获取伙伴系统锁
+    void* pa = buddy_alloc(order);
+    release(&kmem.lock); //* 释放伙伴系统锁
+
+    if (pa)
+        pages[PA2IDX(pa)].ref = 1;
+
+#ifdef KJUNK
+    if (pa) // 填充垃圾
+        memset(pa, 5, PGSIZE << order);
+#endif
+    return pa;
+}
+
+// 释放由kalloc_pages(order)分配的连续页
+void kfree_pages(void* pa, int order)
+{
+    if (order < 0 || order > MAXORDER)
+        panic("kfree_pages: order");
+    if (order == 0) {
+        kfree(pa);
+        return;
+    }
+
+    // 确保按块大小对齐, 并且在可分配范围内
+    if (PA2IDX(pa) % (1 << order) != 0 || (char*)pa < end || (uint64)pa + (PGSIZE << order) > PHYSTOP)
+        panic("kfree_pages");
+
+    // 减少引用计数, 仍有其他引用时不释放
+    if (krefdec(pa) > 0)
+        return;
+
+#ifdef KJUNK
+    // 用垃圾填充以捕获悬空引用
+    memset(pa, 1, PGSIZE << order);
+#endif
+
+    acquire(&kmem.lock); //* 获取伙伴系统锁
+    buddy_free(pa, order);
+    release(&kmem.lock); //* 释放伙伴系统锁
+}
+
+// -------------------------------- Per-CPU -------------------------------- //
+
+// 从链表头部摘下至多n页, 返回摘下的链表, 并将实际页数写入*cnt
+static struct run* kdetach(struct run** list, int n, int* cnt)
+{
+    struct run* head = *list;
+    struct run* tail = NULL;
+    int i = 0;
+
+    for (struct run* r = head; r != NULL && i < n; r = r->next, i++)
+        tail = r;
+
+    if (tail != NULL) {
+        *list = tail->next;
+        tail->next = NULL;
+    }
+    *cnt = i;
+    return head;
+}
+
+// 本地缓存为空时的慢速路径 (调用者已执行push_off)
+// 先从伙伴系统批量补充, 再尝试从其他CPU窃取一半缓存
+static struct run* kalloc_slow(struct kcpu* kc)
+{
+    struct run* batch = NULL;
+    int n = 0;
+
+    acquire(&kmem.lock); //* 获取伙伴系统锁
+    for (struct run* r; n < KBATCH && (r = buddy_alloc(0)) != NULL; n++) {
+        r->next = batch;
+        batch = r;
+    }
+    release(&kmem.lock); //* 释放伙伴系统锁
+
+    if (batch != NULL)
+        kc->miss++;
+
+    // 伙伴系统也为空, 从其他CPU窃取
+    for (int i = 0; batch == NULL && i < NCPU; i++) {
+        struct kcpu* victim = &kmem.cpu[i];
+        if (victim == kc)
+            continue;
+
+        acquire(&victim->lock); //* 获取被窃取CPU的缓存锁
+        batch = kdetach(&victim->freelist, (victim->nfree + 1) / 2, &n);
+        victim->nfree -= n;
+        release(&victim->lock); //* 释放被窃取CPU的缓存锁
+
+        if (batch != NULL)
+            kc->steal++;
+    }
+
+    // 普通空闲页全部耗尽, 最后使用各CPU的预清零池
+    for (int i = 0; batch == NULL && i < NCPU; i++) {
+        struct kcpu* victim = &kmem.cpu[(cpuid() + i) % NCPU];
+
+        acquire(&victim->lock); //* 获取预清零池所在CPU的缓存锁
+        batch = kdetach(&victim->zlist, 1, &n);
+        victim->nzero -= n;
+        release(&victim->lock); //* 释放预清零池所在CPU的缓存锁
+    }
+
+    if (batch == NULL)
+        return NULL;
+
+    // 取出第一页返回, 其余放入本地缓存
+    struct run* r = batch;
+    if (r->next != NULL) {
+        struct run* tail = r->next;
+        while (tail->next != NULL)
+            tail = tail->next;
+
+        acquire(&kc->lock); //* 获取本地缓存锁
+        tail->next = kc->freelist;
+        kc->freelist = r->next;
+        kc->nfree += n - 1;
+        release(&kc->lock); //* 释放本地缓存锁
+    }
+    return r;
 }
 
 // 释放pa指向的物理内存页, 通常应该由kalloc()返回
@@ -46,15 +337,45 @@ void kfree(void* pa)
     if (((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
         panic("kfree");
 
+    // 减少引用计数, 仍有其他引用时不释放
+    if (krefdec(pa) > 0)
+        return;
+
+#ifdef KJUNK
     // 用垃圾填充以捕获悬空引用
     memset(pa, 1, PGSIZE);
+#endif
 
-    // 连接到空闲链表
     r = (struct run*)pa;
-    acquire(&kmem.lock);
-    r->next = kmem.freelist;
-    kmem.freelist = r;
-    release(&kmem.lock);
+
+    push_off(); //* 禁用中断, 确保不会切换CPU
+    struct kcpu* kc = &kmem.cpu[cpuid()];
+
+    // 连接到本地缓存
+    acquire(&kc->lock);
+    r->next = kc->freelist;
+    kc->freelist = r;
+    kc->nfree++;
+
+    // 本地缓存过多, 批量归还到伙伴系统
+    struct run* batch = NULL;
+    int n = 0;
+    if (kc->nfree > KCPUMAX) {
+        batch = kdetach(&kc->freelist, KBATCH, &n);
+        kc->nfree -= n;
+    }
+    release(&kc->lock);
+
+    if (batch != NULL) {
+        acquire(&kmem.lock); //* 获取伙伴系统锁
+        while (batch != NULL) {
+            struct run* next = batch->next;
+            buddy_free(batch, 0);
+            batch = next;
+        }
+        release(&kmem.lock); //* 释放伙伴系统锁
+    }
+    pop_off(); //* 恢复之前的中断状态
 }
 
 // 直接分配4096字节的物理内存页
@@ -62,13 +383,112 @@ void* kalloc(void)
 {
     struct run* r;
 
-    acquire(&kmem.lock);
-    r = kmem.freelist;
+    push_off(); //* 禁用中断, 确保不会切换CPU
+    struct kcpu* kc = &kmem.cpu[cpuid()];
+
+    acquire(&kc->lock);
+    r = kc->freelist;
+    if (r) {
+        kc->freelist = r->next;
+        kc->nfree--;
+        kc->hit++;
+    }
+    release(&kc->lock);
+
+    // 本地缓存为空, 进入慢速路径
+    if (r == NULL)
+        r = kalloc_slow(kc);
+    pop_off(); //* 恢复之前的中断状态
+
+    // 物理内存耗尽, 回收slab缓存后重试
+    if (r == NULL && kmem_cache_reap() > 0)
+        return kalloc();
+
     if (r)
-        kmem.freelist = r->next;
-    release(&kmem.lock);
+        pages[PA2IDX(r)].ref = 1;
 
+#ifdef KJUNK
     if (r) // 填充垃圾
         memset((char*)r, 5, PGSIZE);
+#endif
+    return (void*)r;
+}
+
+// 分配一个已清零的物理页
+// 优先从本地预清零池分配, 未命中时现场清零
+void* kalloc_zeroed(void)
+{
+    struct run* r;
+
+    push_off(); //* 禁用中断, 确保不会切换CPU
+    struct kcpu* kc = &kmem.cpu[cpuid()];
+
+    acquire(&kc->lock);
+    r = kc->zlist;
+    if (r) {
+        kc->zlist = r->next;
+        kc->nzero--;
+        kc->zhit++;
+    } else
+        kc->zmiss++;
+    release(&kc->lock);
+    pop_off(); //* 恢复之前的中断状态
+
+    if (r) {
+        r->next = NULL; // 清除链表指针
+        pages[PA2IDX(r)].ref = 1;
+        return (void*)r;
+    }
+
+    if ((r = kalloc()) != NULL)
+        memset(r, 0, PGSIZE);
     return (void*)r;
 }
+
+// 调度器空闲时调用, 清零一页放入本地预清零池
+// 返回1表示完成了一页, 返回0表示池已满或没有空闲页
+int kzero_idle(void)
+{
+    push_off(); //* 禁用中断, 确保不会切换CPU
+    struct kcpu* kc = &kmem.cpu[cpuid()];
+    int full = (kc->nzero >= KZEROMAX);
+    pop_off(); //* 恢复之前的中断状态
+
+    if (full)
+        return 0;
+
+    // 在不持有任何锁的情况下清零
+    struct run* r = kalloc();
+    if (r == NULL)
+        return 0;
+    memset(r, 0, PGSIZE);
+
+    push_off();
+    kc = &kmem.cpu[cpuid()];
+    acquire(&kc->lock);
+    r->next = kc->zlist;
+    kc->zlist = r;
+    kc->nzero++;
+    release(&kc->lock);
+    pop_off();
+    return 1;
+}
+
+// 打印伙伴系统和每个CPU的页缓存统计 (procdump调用, 不使用锁)
+void kallocdump(void)
+{
+    printf("kalloc: buddy free blocks");
+    for (int k = 0; k <= MAXORDER; k++)
+        printf(" %d", kmem.nfree[k]);
+    printf("\n");
+    for (int i = 0; i < NCPU; i++) {
+        struct kcpu* kc = &kmem.cpu[i];
+        if (kc->hit == 0 && kc->miss == 0 && kc->steal == 0 && kc->nfree == 0 && kc->nzero == 0)
+            continue;
+        printf("  cpu%d: free %d hit %lu miss %lu steal %lu\n", i, kc->nfree, kc->hit, kc->miss, kc->steal);
+
+        // 预清零池命中率
+        uint64 ztotal = kc->zhit + kc->zmiss;
+        printf("        zero %d hit %lu/%lu (%lu%%)\n", kc->nzero, kc->zhit, ztotal, ztotal ? kc->zhit * 100 / ztotal : 0);
+    }
+}
@@ -4,7 +4,7 @@
 //  -------------------------------------------------
 //  + FS.img: 文件系统映像 (mkfs.c)
 //  + VirtIO: 虚拟硬盘驱动 (virtio.h virtio_disk.c)
-//  + BCache: LRU缓存链环 (buf.h bio.c)
+//  + BCache: LRU缓存哈希表 (buf.h bio.c)
 //  + Log: 两步提交的日志系统 (log.c)
 //  + Inode Dir Path: 硬盘文件系统实现 (stat.h fs.h fs.c)
 //  + Pipe: 管道实现 (pipe.c)
@@ -23,6 +23,7 @@
 #include "sleeplock.h"
 #include "buf.h"
 #include "fs.h"
+#include "trace.h"
 
 // 允许并发文件系统调用的简单日志系统
 // https://www.cnblogs.com/KatyuMarisaBlog/p/14385792.html
@@ -153,12 +154,14 @@ static void commit()
 {
     // 先移动数据, 再更新日志头
     if (log.lh.n > 0) {
+        TRACEPOINT(TR_COMMIT_START, log.lh.n, 0);
         write_log();  // 内存-目标块=>硬盘-日志块
         write_head(); // 日志头: 内存=>硬盘 (事务提交)
 
         install_trans(false); // 硬盘: 日志块=>目标块
         log.lh.n = 0;         // 清空内存-日志数
         write_head();         // 日志头: 内存=>硬盘 (事务提交)
+        TRACEPOINT(TR_COMMIT_END, 0, 0);
     }
 }
 
@@ -179,6 +182,7 @@ void begin_op(void)
 
         else {
             log.outstanding++;  // 增加当前事务嵌套数
+            TRACEPOINT(TR_BEGIN_OP, log.outstanding, 0);
             release(&log.lock); //* 释放日志锁
             break;
         }
@@ -194,6 +198,7 @@ void end_op(void)
 
     // 减少当前事务嵌套数
     log.outstanding--;
+    TRACEPOINT(TR_END_OP, log.outstanding, 0);
 
     // 确保现在没有提交
     if (log.committing == true)
@@ -21,19 +21,25 @@ void main()
         kinit();       // 初始化kalloc
         kvminit();     // 初始化内核页表
         kvminithart(); // 当前CPU 设置satp 启用Sv39分页
+        asidinit();    // 检测ASID位数, 初始化ASID分配器
 
-        procinit(); // 初始化进程表
+        procinit();  // 初始化进程表
+        futexinit(); // 初始化futex锁桶
 
         trapinit();     // 初始化计时器中断锁
+        wheelinit();    // 初始化每个CPU的定时器时间轮
         trapinithart(); // 当前CPU 设置stvec跳转到kernelvec.S
 
         plicinit();     // 设置外部中断优先级 (UART VirtIO)
         plicinithart(); // 当前CPU 启用UART和VirtIO中断
 
         binit();            // 初始化cache链环
-        iinit();            // 初始化inode锁
-        fileinit();         // 初始化文件系统锁
+        iinit();            // 初始化inode缓存
+        fileinit();         // 初始化文件描述符缓存
+        pipeinit();         // 初始化管道缓存
         virtio_disk_init(); // 初始化virtio硬盘
+        profinit();         // 初始化采样分析器 (/dev/prof)
+        traceinit();        // 初始化内核事件跟踪 (/dev/trace)
 
         userinit(); // 初始化第一个用户进程 initcode.S
 
@@ -16,6 +16,11 @@
 // end -- 内核空闲页链表的开始地址
 // PHYSTOP -- 内核程序的最大物理内存地址
 
+// CLINT (Core Local Interruptor), 用于发送核间中断
+// 向CLINT_MSIP(hartid)写1, 触发该CPU的M-mode软件中断
+#define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4 * (hartid))
+
 // UART控制寄存器 的内存地址
 #define UART0 0x10000000L
 #define UART0_IRQ 10
@@ -47,18 +52,25 @@
 //      内核代码段
 //      内核其余物理内存
 //      ...
-//      proc[NPROC-1]内核栈
-//      guard page
-//      proc[NPROC-2]内核栈
+//      第NPROC-1个进程结构体的内核栈
 //      guard page
 //      ...
-//      proc[0]内核栈
+//      第1个进程结构体的内核栈
+//      guard page
+//      第0个进程结构体的内核栈
 //      guard page
 //      TRAMPOLINE
+//      ...
+//      UWINBASE 用户窗口 (只存在于进程的内核页表p->kpagetable)
 // >高地址
-// 依次映射每个进程的内核栈到内核空间
+// 按进程结构体的分配顺序映射内核栈到内核空间 (proc.c->procnew)
 #define KSTACK(p) (TRAMPOLINE - ((p) + 1) * 2 * PGSIZE)
 
+// Sv39高半部分 [UWINBASE, UWINBASE+MAXVA) 恰好容纳整个用户地址空间
+// 进程内核页表的第2级索引256~511共享用户页表的第2级索引0~255
+// 内核可以通过 UWINBASE+va 直接访问用户虚拟地址va (vm.c->copyin/copyout)
+#define UWINBASE 0xFFFFFFC000000000L
+
 // 用户虚拟内存布局 (proc.c->proc_pagetable)
 // >低地址
 //   代码段
@@ -66,8 +78,13 @@
 //   用户栈空间
 //   用户堆空间
 //   ...
-//   TRAPFRAME (p->trapframe)
+//   MMAPBASE
+//   内存映射区域 (从高地址向下分配)
+//   TRAPFRAME(MAXTHREAD-1) ... TRAPFRAME(0) (每个线程的p->trapframe)
 //   TRAMPOLINE (内核代码段trampoline.S)
 // >高地址
-#define TRAMPOLINE (MAXVA - PGSIZE) // trampoline页映射到最高虚拟地址, 用于用户和内核空间
-#define TRAPFRAME (TRAMPOLINE - PGSIZE) // trapframe页映射到trampoline页的相邻低地址
+#define MAXTHREAD 64                                         // 每个地址空间的最大线程数 (trapframe槽位数)
+#define TRAMPOLINE (MAXVA - PGSIZE)                          // trampoline页映射到最高虚拟地址, 用于用户和内核空间
+#define TRAPFRAME(slot) (TRAMPOLINE - ((slot) + 1) * PGSIZE) // 第slot个线程的trapframe页
+#define MMAPBASE (MAXVA / 2)                                 // 内存映射区域下限, 也是用户堆空间上限
+#define MMAPTOP TRAPFRAME(MAXTHREAD - 1)                     // 内存映射区域上限
@@ -0,0 +1,467 @@
+// 进程内存映射 (mmap/munmap)
+//
+// 每个进程持有NVMA个虚拟内存区域(VMA), 位于堆空间之上的 [MMAPBASE, MMAPTOP)
+// mmap只记录VMA, 物理页在首次访问时由vmfault->mmapfault分配
+// 文件映射的页通过readi从缓冲区缓存读入
+// MAP_SHARED: fork后父子共享物理页, 脏页在munmap/exit时写回文件
+// MAP_PRIVATE: fork后写时复制, 修改不会写回文件
+// MAP_HUGETLB: 匿名映射按2MB对齐, 首次访问时分配连续的2MB物理内存并以大页映射
+//
+// VMA属于地址空间(struct mm), 由共享它的所有线程共用, 修改VMA和页表时持有mm->lock
+// 读写文件会休眠, 不能持有mm->lock进行: 写回脏页时逐页取出, 读入文件页时暂时释放锁
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+#include "defs.h"
+
+// 返回与 [start, end) 重叠的VMA (需持有mm->lock)
+static struct vma* vmaoverlap(struct proc* p, uint64 start, uint64 end)
+{
+    for (int i = 0; i < NVMA; i++) {
+        struct vma* v = &p->mm->vma[i];
+        if (v->len > 0 && v->addr < end && start < v->addr + v->len)
+            return v;
+    }
+    return NULL;
+}
+
+// va是否位于共享映射中 (futex.c调用, 需持有mm->lock)
+int mmapshared(struct proc* p, uint64 va)
+{
+    struct vma* v = vmaoverlap(p, va, va + 1);
+    return v != NULL && (v->flags & MAP_SHARED);
+}
+
+// 返回一个空闲的VMA (需持有mm->lock)
+static struct vma* vmaalloc(struct proc* p)
+{
+    for (int i = 0; i < NVMA; i++)
+        if (p->mm->vma[i].len == 0)
+            return &p->mm->vma[i];
+    return NULL;
+}
+
+// 在mmap区域中从高地址向下寻找长度为len, 按align对齐的空闲区间, 失败返回0
+static uint64 vmafind(struct proc* p, uint64 len, uint64 align)
+{
+    if (len > MMAPTOP - MMAPBASE)
+        return 0;
+
+    uint64 a = (MMAPTOP - len) & ~(align - 1);
+    for (;;) {
+        if (a < MMAPBASE)
+            return 0;
+        struct vma* v = vmaoverlap(p, a, a + len);
+        if (v == NULL)
+            return a;
+
+        // 跳到重叠区域的下方继续寻找
+        if (v->addr < MMAPBASE + len)
+            return 0;
+        a = (v->addr - len) & ~(align - 1);
+    }
+}
+
+// 将VMA中 [start, end) 内的脏页写回文件 (不能持有mm->lock)
+// v是调用者持有的副本, 其中的文件引用在写回期间有效
+// 每页在mm->lock下清除脏位并增加物理页的引用, 写回期间其他线程移除映射也不会释放该页
+// 同时收回写权限并刷新TLB, 其他线程之后的写入会重新产生页错误并标记脏页 (mmapfault)
+static void vmawriteback(struct proc* p, struct vma* v, uint64 start, uint64 end)
+{
+    if (v->f == NULL || (v->flags & MAP_SHARED) == 0 || (v->prot & PROT_WRITE) == 0)
+        return;
+
+    // 与filewrite相同, 限制单次事务写入的块数
+    int op_maxlen = ((MAXOPBLOCKS - 1 - 1 - 2) / 2) * BSIZE;
+    struct minode* ip = v->f->mip;
+    struct mm* mm = p->mm;
+
+    for (uint64 va = start; va < end; va += PGSIZE) {
+        acquire(&mm->lock);
+        pte_t* pte = walk(mm->pagetable, va, false);
+        if (pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_D) == 0) {
+            release(&mm->lock);
+            continue;
+        }
+
+        // 写回之前清除脏位和写权限, 写回期间及之后的写入会重新标记
+        uint64 pa = PTE2PA(*pte);
+        *pte &= ~(PTE_W | PTE_D);
+        uvmflush(mm->pagetable, va);
+        krefinc((void*)pa);
+        release(&mm->lock);
+
+        uint off = v->off + (va - v->addr);
+        for (int i = 0; i < PGSIZE; i += op_maxlen) {
+            begin_op(); //* 事务开始
+            ilock(ip);  //** 获取inode锁 (休眠)
+
+            // 不扩展文件, 只写回文件范围内的部分
+            if (off + i < ip->size) {
+                uint n = PGSIZE - i;
+                if (n > op_maxlen)
+                    n = op_maxlen;
+                if (n > ip->size - (off + i))
+                    n = ip->size - (off + i);
+                writei(ip, false, pa + i, off + i, n);
+            }
+
+            iunlock(ip); //** 释放inode锁 (唤醒)
+            end_op();    //* 事务结束
+        }
+        kfree((void*)pa); // 减少物理页的引用
+    }
+}
+
+// 创建一个内存映射, 返回映射的起始地址, 失败返回-1
+// addr只作为提示, 不可用时由内核选择地址
+// f为NULL表示匿名映射
+uint64 mmap(uint64 addr, uint64 len, int prot, int flags, struct file* f, uint64 off)
+{
+    struct proc* p = myproc();
+
+    if (len == 0 || (off % PGSIZE) != 0)
+        return -1;
+    if (len > MMAPTOP - MMAPBASE)
+        return -1;
+
+    // 大页只用于匿名映射, 长度和地址都按2MB对齐
+    uint64 align = PGSIZE;
+    if (flags & MAP_HUGETLB) {
+        if ((flags & MAP_ANONYMOUS) == 0)
+            return -1;
+        align = MEGAPGSIZE;
+    }
+    len = (len + align - 1) & ~(align - 1);
+
+    // MAP_SHARED和MAP_PRIVATE必须二选一
+    if (((flags & MAP_SHARED) != 0) == ((flags & MAP_PRIVATE) != 0))
+        return -1;
+
+    if ((flags & MAP_ANONYMOUS) == 0) {
+        // 只能映射可读的磁盘文件, 可写的共享映射要求文件可写
+        if (f == NULL || f->type != FD_INODE || !f->readable)
+            return -1;
+        if ((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+            return -1;
+    } else
+        f = NULL;
+
+    acquire(&p->mm->lock);
+    struct vma* v = vmaalloc(p);
+    if (v == NULL) {
+        release(&p->mm->lock);
+        return -1;
+    }
+
+    // 使用提示地址, 或者寻找空闲区间
+    if (addr % align != 0 || addr < MMAPBASE || addr > MMAPTOP - len || vmaoverlap(p, addr, addr + len))
+        addr = vmafind(p, len, align);
+    if (addr == 0) {
+        release(&p->mm->lock);
+        return -1;
+    }
+
+    v->addr = addr;
+    v->len = len;
+    v->prot = prot;
+    v->flags = flags;
+    v->off = off;
+    v->f = f ? filedup(f) : NULL;
+    release(&p->mm->lock);
+    return addr;
+}
+
+// 移除 [addr, addr+len) 内的内存映射, 允许只移除VMA的一部分
+// 成功返回0, 失败返回-1
+int munmap(uint64 addr, uint64 len)
+{
+    struct proc* p = myproc();
+
+    if (addr % PGSIZE != 0 || len == 0 || addr + len < addr)
+        return -1;
+    uint64 end = PGROUNDUP(addr + len);
+    struct mm* mm = p->mm;
+
+    // 先写回范围内的脏页 (写文件会休眠, 不持有mm->lock)
+    for (int i = 0; i < NVMA; i++) {
+        acquire(&mm->lock);
+        struct vma v = mm->vma[i];
+        if (v.len > 0 && v.f)
+            filedup(v.f);
+        release(&mm->lock);
+        if (v.len == 0)
+            continue;
+
+        uint64 a = addr > v.addr ? addr : v.addr;
+        uint64 b = end < v.addr + v.len ? end : v.addr + v.len;
+        if (a < b)
+            vmawriteback(p, &v, a, b);
+        if (v.f)
+            fileclose(v.f);
+    }
+
+    acquire(&mm->lock);
+
+    // 从中间拆分VMA时需要一个空闲的VMA, 先确认不会中途失败
+    struct vma* v = vmaoverlap(p, addr, end);
+    if (v != NULL && v->addr < addr && end < v->addr + v->len && vmaalloc(p) == NULL) {
+        release(&mm->lock);
+        return -1;
+    }
+
+    // 大页只能整体移除, 涉及大页映射时要求范围按2MB对齐
+    for (int i = 0; i < NVMA; i++) {
+        struct vma* hv = &mm->vma[i];
+        if (hv->len > 0 && (hv->flags & MAP_HUGETLB) && hv->addr < end && addr < hv->addr + hv->len &&
+            (addr % MEGAPGSIZE != 0 || end % MEGAPGSIZE != 0)) {
+            release(&mm->lock);
+            return -1;
+        }
+    }
+
+    // 被整体移除的VMA的文件引用, 释放mm->lock之后再关闭 (最后一个引用会休眠)
+    struct file* closef[NVMA];
+    int nclose = 0;
+
+    while ((v = vmaoverlap(p, addr, end)) != NULL) {
+        uint64 vend = v->addr + v->len;
+        uint64 a = addr > v->addr ? addr : v->addr;
+        uint64 b = end < vend ? end : vend;
+
+        uvmunmap(mm->pagetable, a, (b - a) / PGSIZE, true);
+
+        if (a == v->addr && b == vend) {
+            // 整个VMA被移除
+            if (v->f)
+                closef[nclose++] = v->f;
+            v->len = 0;
+            v->f = NULL;
+        } else if (a == v->addr) {
+            // 移除头部
+            v->off += b - v->addr;
+            v->addr = b;
+            v->len = vend - b;
+        } else if (b == vend) {
+            // 移除尾部
+            v->len = a - v->addr;
+        } else {
+            // 移除中间, 拆分为两个VMA
+            struct vma* nv = vmaalloc(p);
+            *nv = *v;
+            nv->addr = b;
+            nv->len = vend - b;
+            nv->off = v->off + (b - v->addr);
+            if (nv->f)
+                filedup(nv->f);
+            v->len = a - v->addr;
+        }
+    }
+    release(&mm->lock);
+
+    for (int i = 0; i < nclose; i++)
+        fileclose(closef[i]);
+    return 0;
+}
+
+// 移除进程的所有内存映射
+// exit (最后一个线程) 和exec (地址空间不共享) 调用, 没有其他线程会同时修改VMA
+void munmapall(struct proc* p)
+{
+    for (int i = 0; i < NVMA; i++) {
+        struct vma* v = &p->mm->vma[i];
+        if (v->len == 0)
+            continue;
+
+        vmawriteback(p, v, v->addr, v->addr + v->len);
+        uvmunmap(p->pagetable, v->addr, v->len / PGSIZE, true);
+        if (v->f)
+            fileclose(v->f);
+        v->len = 0;
+        v->f = NULL;
+    }
+}
+
+// 为VMA中的va分配一页物理内存并映射, 文件映射从文件读入页内容 (需持有mm->lock)
+// 大页映射分配并映射va所在的整个2MB大页
+// 读取文件时暂时释放mm->lock, 之后重新检查VMA, 期间其他线程可能已经映射或移除了该页
+// maysleep为假时不能读取文件 (vm.c->vmfault), 文件映射页失败
+static int vmapage(struct proc* p, struct vma* v, uint64 va, int write, int maysleep)
+{
+    int huge = (v->flags & MAP_HUGETLB) != 0;
+    uint64 size = huge ? MEGAPGSIZE : PGSIZE;
+    char* mem;
+
+    if (huge) {
+        va = MEGAROUNDDOWN(va);
+        if ((mem = kalloc_pages(MEGAPGORDER)) == 0)
+            return -1;
+        memset(mem, 0, MEGAPGSIZE);
+    } else if ((mem = kalloc_zeroed()) == 0)
+        return -1;
+
+    // 从文件读入页内容, 超出文件末尾的部分保持为零
+    if (v->f) {
+        // 读取文件需要获取inode锁并休眠, 调用者可能正持有同一个inode的锁
+        // 内核中的访问只能使用mmapprefault预先读入的页
+        if (!maysleep) {
+            kfree(mem);
+            return -1;
+        }
+
+        struct file* f = filedup(v->f);
+        uint off = v->off + (va - v->addr);
+        release(&p->mm->lock);
+
+        ilock(f->mip); //** 获取inode锁 (休眠)
+        readi(f->mip, false, (uint64)mem, off, PGSIZE);
+        iunlock(f->mip); //** 释放inode锁 (唤醒)
+        fileclose(f);
+
+        acquire(&p->mm->lock);
+
+        // 其他线程已经映射了该页, 使用已有的映射
+        if (walkaddr(p->pagetable, va) != 0) {
+            kfree(mem);
+            return 0;
+        }
+
+        // 其他线程移除或修改了映射
+        v = vmaoverlap(p, va, va + 1);
+        if (v == NULL || v->f == NULL || v->f->mip != f->mip || v->off + (va - v->addr) != off) {
+            kfree(mem);
+            return -1;
+        }
+    }
+
+    // 共享映射只在写入时授予写权限, 以便记录脏页
+    int perm = PTE_U | PTE_R;
+    if (v->prot & PROT_EXEC)
+        perm |= PTE_X;
+    if ((v->prot & PROT_WRITE) && (write || (v->flags & MAP_PRIVATE)))
+        perm |= PTE_W;
+    if (write && (v->flags & MAP_SHARED))
+        perm |= PTE_D;
+
+    // va=va, pa=mem, size=size, perm=perm
+    // 大页所在区域不能保留第0级页表
+    if ((huge && uvmdetach(p->pagetable, va) < 0) || mappages(p->pagetable, va, size, (uint64)mem, perm) != 0) {
+        if (huge)
+            kfree_pages(mem, MEGAPGORDER);
+        else
+            kfree(mem);
+        return -1;
+    }
+
+    // TLB可能缓存了无效的页表项, 大页覆盖的所有页都需要刷新
+    uvmflush(p->pagetable, huge ? -1 : va);
+    return 0;
+}
+
+// 处理mmap区域内的页错误 (vmfault调用, 持有mm->lock)
+// 成功返回0, 非法访问或内存不足返回-1
+int mmapfault(struct proc* p, uint64 va, int write, int maysleep)
+{
+    struct vma* v = vmaoverlap(p, va, va + 1);
+    if (v == NULL)
+        return -1;
+    if ((v->prot & (write ? PROT_WRITE : PROT_READ | PROT_EXEC)) == 0)
+        return -1;
+
+    va = PGROUNDDOWN(va);
+    pte_t* pte = walk(p->pagetable, va, false);
+
+    // 共享可写页的首次写入, 授予写权限并标记为脏页
+    if (pte != 0 && (*pte & PTE_V)) {
+        if (write && (v->flags & MAP_SHARED)) {
+            *pte |= PTE_W | PTE_D;
+            uvmflush(p->pagetable, va);
+            return 0;
+        }
+        return -1;
+    }
+
+    return vmapage(p, v, va, write, maysleep);
+}
+
+// 预先处理用户缓冲区 [va, va+len) 中文件映射页的页错误 (fileread/filewrite, fetchstr调用, 不持有锁)
+// copyin/copyout不会从文件读入映射页, 因为它们可能在持有inode锁, 缓冲区锁或自旋锁时调用
+// 失败的页留给之后的copyin/copyout报告错误
+void mmapprefault(uint64 va, uint64 len, int write)
+{
+    struct proc* p = myproc();
+    uint64 end = va + len;
+    if (end < va)
+        return;
+
+    struct mm* mm = p->mm;
+    for (int i = 0; i < NVMA; i++) {
+        acquire(&mm->lock);
+        struct vma v = mm->vma[i];
+        release(&mm->lock);
+        if (v.len == 0 || v.f == NULL || end <= v.addr || v.addr + v.len <= va)
+            continue;
+
+        uint64 a = PGROUNDDOWN(va > v.addr ? va : v.addr);
+        uint64 b = end < v.addr + v.len ? end : v.addr + v.len;
+        for (; a < b; a += PGSIZE) {
+            acquire(&mm->lock);
+            pte_t* pte = walk(p->pagetable, a, false);
+            int fault = pte == 0 || (*pte & PTE_V) == 0 || (write && (*pte & PTE_W) == 0);
+            release(&mm->lock);
+            if (fault)
+                vmfault(p->pagetable, a, write, true);
+        }
+    }
+}
+
+// 将父进程的内存映射复制给子进程 (fork调用, 持有np->lock和父进程的mm->lock)
+// 共享映射的物理页由父子共享, 私有映射的物理页写时复制
+// 成功返回0, 失败时撤销已复制的映射并返回-1
+int mmapfork(struct proc* p, struct proc* np)
+{
+    int i;
+    for (i = 0; i < NVMA; i++) {
+        struct vma* v = &p->mm->vma[i];
+        if (v->len == 0)
+            continue;
+
+        // 匿名共享映射没有文件作为后备, 尚未访问的页必须先分配才能被父子共享
+        if (v->f == NULL && (v->flags & MAP_SHARED)) {
+            uint64 step = (v->flags & MAP_HUGETLB) ? MEGAPGSIZE : PGSIZE;
+            for (uint64 va = v->addr; va < v->addr + v->len; va += step)
+                if (walkaddr(p->pagetable, va) == 0 && vmapage(p, v, va, false, false) < 0)
+                    goto err;
+        }
+
+        if (uvmshare(p->pagetable, np->pagetable, v->addr, v->len, (v->flags & MAP_PRIVATE) != 0) < 0)
+            goto err;
+
+        np->mm->vma[i] = *v;
+        if (v->f)
+            filedup(v->f);
+    }
+    return 0;
+
+err:
+    // 子进程持有的文件引用不是最后一个, fileclose不会休眠
+    for (int j = 0; j < i; j++) {
+        struct vma* nv = &np->mm->vma[j];
+        if (nv->len == 0)
+            continue;
+        uvmunmap(np->pagetable, nv->addr, nv->len / PGSIZE, true);
+        if (nv->f)
+            fileclose(nv->f);
+        nv->len = 0;
+        nv->f = NULL;
+    }
+    return -1;
+}
@@ -1,11 +1,11 @@
 
 
-#define NPROC 64                  // 进程的最大数量
+#define NPROC 1024                // 进程的最大数量 (进程结构体按需分配)
 #define NCPU 8                    // CPU的最大数量
 #define BSIZE 1024                // 块大小
 #define NOFILE 16                 // 每个进程的最大打开文件数
-#define NFILE 100                 // 文件描述符表的最大数量
-#define NINODE 50                 // 内存-索引数
+#define NVMA 16                   // 每个进程的最大内存映射数
+#define NINODE 50                 // 内存-索引数 (usertests的iref测试使用, 内核中动态分配)
 #define NDEV 10                   // 最大主设备号
 #define ROOTDEV 1                 // 根目录设备号
 #define MAXARG 32                 // max exec arguments
@@ -15,3 +15,8 @@
 #define FSSIZE 2000               // 文件系统总块数
 #define MAXPATH 128               // maximum file path name
 #define USERSTACK 1               // 用户栈页数
+#define TIMEBASE 10000000         // time寄存器的频率 (QEMU virt为10MHz)
+#define TIMER_INTERVAL 1000000    // 时钟周期 (time周期数, 大约0.1秒), ticks的单位
+#ifndef TIMESLICE
+#define TIMESLICE TIMER_INTERVAL  // 进程时间片 (time周期数), 可以通过 make TIMESLICE=n 设置
+#endif
@@ -4,7 +4,7 @@
 //  -------------------------------------------------
 //  + FS.img: 文件系统映像 (mkfs.c)
 //  + VirtIO: 虚拟硬盘驱动 (virtio.h virtio_disk.c)
-//  + BCache: LRU缓存链环 (buf.h bio.c)
+//  + BCache: LRU缓存哈希表 (buf.h bio.c)
 //  + Log: 两步提交的日志系统 (log.c)
 //  + Inode Dir Path: 硬盘文件系统实现 (stat.h fs.h fs.c)
 //  + Pipe: 管道实现 (pipe.c)
@@ -38,15 +38,24 @@ struct pipe {
     uint nwrite; // 写位置
 };
 
+// 管道对象缓存
+static struct kmem_cache* pipe_cache;
+
+void pipeinit(void) { pipe_cache = kmem_cache_create("pipe", sizeof(struct pipe)); }
+
 int pipealloc(file** rf, file** wf)
 {
     *rf = *wf = NULL;
     struct pipe* pi = NULL;
 
-    if ((*rf = filealloc()) == NULL || (*wf = filealloc()) == NULL)
-        panic("pipealloc");
-    if ((pi = (struct pipe*)kalloc()) == NULL)
-        panic("pipealloc");
+    if ((*rf = filealloc()) == NULL || (*wf = filealloc()) == NULL
+        || (pi = (struct pipe*)kmem_cache_alloc(pipe_cache)) == NULL) {
+        if (*rf)
+            fileclose(*rf);
+        if (*wf)
+            fileclose(*wf);
+        return -1;
+    }
 
     initlock(&pi->lock, "pipe");
     pi->readopen = true;
@@ -80,8 +89,8 @@ void pipeclose(struct pipe* pi, int writable)
     }
 
     if (pi->readopen == false && pi->writeopen == false) {
-        release(&pi->lock); //* 释放管道锁
-        kfree((char*)pi);   // 释放管道内存
+        release(&pi->lock);              //* 释放管道锁
+        kmem_cache_free(pipe_cache, pi); // 释放管道内存
     } else
         release(&pi->lock); //* 释放管道锁
 }
@@ -97,13 +106,15 @@ int pipewrite(struct pipe* pi, uint64 addr, int n)
     while (i < n) {
         // 如果读端已关闭 或者进程有终止标志
         if (pi->readopen == false || killed(pr)) {
+            if (pi->nwrite < pi->nread + PIPESIZE)
+                wakeone(&pi->nwrite); // 没有使用剩余空间, 交给下一个写端
             release(&pi->lock); //* 释放管道锁
             return -1;
         }
 
         // 如果管道已满
         if (pi->nwrite == pi->nread + PIPESIZE) {
-            wakeup(&pi->nread);            // 唤醒读端
+            wakeone(&pi->nread);           // 唤醒一个读端
             sleep(&pi->nwrite, &pi->lock); //* 休眠写端
         }
 
@@ -117,7 +128,10 @@ int pipewrite(struct pipe* pi, uint64 addr, int n)
         }
     }
 
-    wakeup(&pi->nread); // 唤醒读端
+    // 唤醒一个读端, 管道仍有空间时再唤醒下一个写端
+    wakeone(&pi->nread);
+    if (pi->nwrite < pi->nread + PIPESIZE)
+        wakeone(&pi->nwrite);
     release(&pi->lock); //* 释放管道锁
     return i;
 }
@@ -147,7 +161,10 @@ int piperead(struct pipe* pi, uint64 addr, int n)
             break;
     }
 
-    wakeup(&pi->nwrite); // 唤醒写端
-    release(&pi->lock);  //* 释放管道锁
+    // 唤醒一个写端, 管道仍有数据时再唤醒下一个读端
+    wakeone(&pi->nwrite);
+    if (pi->nread != pi->nwrite)
+        wakeone(&pi->nread);
+    release(&pi->lock); //* 释放管道锁
     return i;
 }
@@ -5,53 +5,142 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "fcntl.h"
+#include "trace.h"
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// 进程表
+// 进程结构体在需要时从slab分配, 并映射一个新的内核栈, 之后不再释放 (类型稳定)
+// 因此cpus[].proc, 运行队列和休眠队列中的指针不加锁读取时, 最坏只会读到一个已经回收的进程
+// UNUSED的进程结构体放在空闲链表中, 分配和回收都是O(1)
+struct {
+    struct spinlock lock;
+    struct proc* free;        // 空闲链表
+    struct proc* all;         // 所有进程结构体 (只增不减, 遍历进程时使用)
+    int n;                    // 已分配的进程结构体数, 也是下一个内核栈的编号
+    struct kmem_cache* cache; // 进程结构体对象缓存
+} ptable;
 
 struct proc* initproc;
 
+// 每个CPU的运行队列
+// 进程变为RUNNABLE时加入当前CPU的队列, 调度器先取本地队列,
+// 本地队列为空或者其他CPU的负载明显更重时, 从其他CPU的队列窃取
+//
+// 加权公平调度: 每个进程累计按nice权重缩放的虚拟运行时间(vruntime),
+// 队列按vruntime从小到大排列, 调度器总是选择vruntime最小的进程
+// 权重为1024的进程(nice 0)运行1个时钟周期, vruntime增加1个周期
+struct runq {
+    struct spinlock lock;
+    struct proc* head; // 队首 (vruntime最小的进程)
+    int n;             // 队列中的进程数 (可以不加锁读取, 作为提示)
+    uint64 load;       // 队列中进程的权重之和 (可以不加锁读取, 作为提示)
+    uint64 minvrt;     // 队列的最小vruntime (单调递增), 新加入的进程以此为参照
+
+    uint64 nrun;  // 调度运行的次数
+    uint64 steal; // 从其他CPU窃取的次数
+} runqs[NCPU];
+
+#define NICE_MIN (-20)
+#define NICE_MAX 19
+#define NICE0_WEIGHT 1024
+
+// nice值对应的权重, nice每增加1, 权重约减少为1/1.25 (与Linux CFS相同)
+static const int nice2weight[NICE_MAX - NICE_MIN + 1] = {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */ 9548, 7620, 6100, 4904, 3906,
+    /*  -5 */ 3121, 2501, 1991, 1586, 1277,
+    /*   0 */ 1024, 820, 655, 526, 423,
+    /*   5 */ 335, 272, 215, 172, 137,
+    /*  10 */ 110, 87, 70, 56, 45,
+    /*  15 */ 36, 29, 23, 18, 15,
+};
+
+// 休眠后被唤醒的进程, vruntime至多比队列最小值少半个时钟中断间隔
+// 既能让交互进程优先运行, 又不会让它长期独占CPU
+#define SCHED_WAKEUP (TIMER_INTERVAL / 2)
+
+// vruntime允许回绕, 使用有符号差值比较
+#define VRT_BEFORE(a, b) ((long)((a) - (b)) < 0)
+
+// 休眠队列哈希表
+// sleep()将进程加入chan对应的桶, wakeup()只检查该桶中的进程, 而不是整个进程表
+#define NSLEEPQ 64
+struct sleepq {
+    struct spinlock lock;
+    struct proc* head; // 最早休眠的进程
+    struct proc* tail; // 最晚休眠的进程
+} sleepqs[NSLEEPQ];
+
 int nextpid = 1; // 分配pid
 struct spinlock pid_lock;
 
+// pid哈希表 (由pid_lock保护), 按pid查找进程 (kill等) 不需要遍历所有进程
+#define NPIDHASH 64
+struct proc* pidhash[NPIDHASH];
+#define PIDHASH(pid) ((pid) % NPIDHASH)
+
+struct kmem_cache* mm_cache;  // 地址空间对象缓存
+struct kmem_cache* fdt_cache; // 文件描述符表对象缓存
+
 extern void forkret(void);
 static void freeproc(struct proc* p);
 
 extern char trampoline[]; // trampoline.S
 
 // 帮助确保 对等待中的父进程的唤醒不会丢失
-// 在使用p->parent时遵守内存模型
+// 在使用p->parent和子进程链表时遵守内存模型
 // 必须在任何p->lock之前获取
 struct spinlock wait_lock;
 
-// 为每个进程分配内核栈, 并映射到内核虚拟内存高地址
-void proc_mapstacks(pagetable_t kpgtbl)
+// 将统计src累加到dst
+static void acctadd(struct pacct* dst, struct pacct* src)
 {
-    struct proc* p;
+    dst->utime += src->utime;
+    dst->stime += src->stime;
+    dst->nvcsw += src->nvcsw;
+    dst->nivcsw += src->nivcsw;
+    dst->nsyscall += src->nsyscall;
+    dst->nfault += src->nfault;
+}
 
-    for (p = proc; p < &proc[NPROC]; p++) {
-        char* pa = kalloc();
-        if (pa == 0)
-            panic("kalloc");
-        uint64 va = KSTACK((int)(p - proc));
-        // 映射内核栈到内核虚拟内存高地址 va=va, pa=pa, size=PGSIZE, perm=可读可写
-        kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
-    }
+// 将p加入parent的子进程链表 (需持有wait_lock)
+static void childadd(struct proc* parent, struct proc* p)
+{
+    p->parent = parent;
+    p->sibling = parent->children;
+    p->psibling = &parent->children;
+    if (parent->children)
+        parent->children->psibling = &p->sibling;
+    parent->children = p;
 }
 
-// 初始化进程表
-void procinit(void)
+// 将p移出父进程的子进程链表 (需持有wait_lock)
+static void childdel(struct proc* p)
 {
-    struct proc* p;
+    *p->psibling = p->sibling;
+    if (p->sibling)
+        p->sibling->psibling = p->psibling;
+    p->parent = 0;
+    p->sibling = 0;
+    p->psibling = 0;
+}
 
+// 初始化进程表 (进程结构体在allocproc中按需分配)
+void procinit(void)
+{
+    initlock(&ptable.lock, "ptable");
     initlock(&pid_lock, "nextpid");
     initlock(&wait_lock, "wait_lock");
-    for (p = proc; p < &proc[NPROC]; p++) {
-        initlock(&p->lock, "proc");          // 初始化进程锁
-        p->state = UNUSED;                   // 未使用状态
-        p->kstack = KSTACK((int)(p - proc)); // 内核栈的起始地址
-    }
+    ptable.cache = kmem_cache_create("proc", sizeof(struct proc));
+    mm_cache = kmem_cache_create("mm", sizeof(struct mm));
+    fdt_cache = kmem_cache_create("fdtable", sizeof(struct fdtable));
+    for (int i = 0; i < NCPU; i++)
+        initlock(&runqs[i].lock, "runq");
+    for (int i = 0; i < NSLEEPQ; i++)
+        initlock(&sleepqs[i].lock, "sleepq");
 }
 
 // 调用时必须关闭中断
@@ -81,38 +170,242 @@ struct proc* myproc(void)
     return p;
 }
 
-// 分配新的pid
-int allocpid()
+// 分配新的pid, 并将p加入pid哈希表 (需持有p->lock)
+// 锁顺序: p->lock 先于 pid_lock
+static int allocpid(struct proc* p)
 {
-    int pid;
-
     acquire(&pid_lock);
-    pid = nextpid;
+    int pid = nextpid;
     nextpid = nextpid + 1;
+    p->pid = pid;
+    p->pidnext = pidhash[PIDHASH(pid)];
+    pidhash[PIDHASH(pid)] = p;
     release(&pid_lock);
 
     return pid;
 }
 
-// 在进程表中查找UNUSED进程
-// 如果找到, 初始化内核运行所需的状态并返回 (持有p->lock的锁)
-// 如果没有空闲进程, 或内存分配失败, 返回0
-static struct proc* allocproc(void)
+// 将p移出pid哈希表 (需持有p->lock)
+static void freepid(struct proc* p)
 {
-    struct proc* p;
+    acquire(&pid_lock);
+    struct proc** pp = &pidhash[PIDHASH(p->pid)];
+    while (*pp != p)
+        pp = &(*pp)->pidnext;
+    *pp = p->pidnext;
+    p->pidnext = 0;
+    release(&pid_lock);
+}
 
-    for (p = proc; p < &proc[NPROC]; p++) {
-        acquire(&p->lock); //* 获取进程锁
-        if (p->state == UNUSED)
-            goto found; // 找到空闲进程
-        else
-            release(&p->lock);
+// 查找pid对应的进程, 找到时返回该进程并持有p->lock, 否则返回0
+// 进程结构体是类型稳定的, 释放pid_lock之后再获取p->lock并重新检查pid
+// pid不会重复使用, 因此重新检查通过时就是要找的进程
+static struct proc* pidlookup(int pid)
+{
+    acquire(&pid_lock);
+    struct proc* p = pidhash[PIDHASH(pid)];
+    while (p && p->pid != pid)
+        p = p->pidnext;
+    release(&pid_lock);
+
+    if (p == 0)
+        return 0;
+    acquire(&p->lock);
+    if (p->pid != pid || p->state == UNUSED) {
+        release(&p->lock);
+        return 0;
+    }
+    return p;
+}
+
+// 分配一个新的进程结构体, 并为它分配和映射内核栈 (空闲链表为空时调用)
+// 达到NPROC或内存不足时返回0
+static struct proc* procnew(void)
+{
+    struct proc* p = kmem_cache_alloc(ptable.cache);
+    char* stack = kalloc();
+    if (p == 0 || stack == 0)
+        goto bad;
+
+    memset(p, 0, sizeof(*p));
+    initlock(&p->lock, "proc");
+    p->state = UNUSED;
+
+    acquire(&ptable.lock);
+    if (ptable.n >= NPROC || kvmmapstack(KSTACK(ptable.n), (uint64)stack) < 0) {
+        release(&ptable.lock);
+        goto bad;
     }
+    p->kstack = KSTACK(ptable.n);
+    ptable.n++;
+
+    // 初始化完成后才加入链表, 不加锁遍历的读者不会看到未初始化的进程结构体
+    __sync_synchronize();
+    p->allnext = ptable.all;
+    ptable.all = p;
+    release(&ptable.lock);
+    return p;
+
+bad:
+    if (p)
+        kmem_cache_free(ptable.cache, p);
+    if (stack)
+        kfree(stack);
     return 0;
+}
 
-found:
-    p->pid = allocpid(); // 分配新的pid
-    p->state = USED;     // 更新状态为USED
+// 创建一个新的地址空间 (引用计数为0, 由mmattach加入线程)
+// 用户页表暂时只有trampoline页, 失败返回0
+static struct mm* mmalloc(void)
+{
+    struct mm* mm = kmem_cache_alloc(mm_cache);
+    if (mm == 0)
+        return 0;
+    memset(mm, 0, sizeof(*mm));
+    initlock(&mm->lock, "mm");
+
+    // 配置用户态页表 (trampoline代码段)
+    if ((mm->pagetable = proc_pagetable()) == 0) {
+        kmem_cache_free(mm_cache, mm);
+        return 0;
+    }
+
+    // 配置内核页表 (共享内核映射, 并通过用户窗口访问用户页表)
+    if ((mm->kpagetable = kvmcreate(mm->pagetable)) == 0) {
+        proc_freepagetable(mm->pagetable, 0, 0);
+        kmem_cache_free(mm_cache, mm);
+        return 0;
+    }
+    return mm;
+}
+
+// 释放地址空间, 以及用户页表引用的物理内存
+static void mmfree(struct mm* mm)
+{
+    proc_freepagetable(mm->pagetable, 0, mm->sz);
+    kfree((void*)mm->kpagetable); // 只有第2级页表页属于进程
+    kmem_cache_free(mm_cache, mm);
+}
+
+// 将线程p加入地址空间mm: 分配一个trapframe槽位并映射p->trapframe
+// 成功返回0, 槽位用完或内存不足返回-1
+static int mmattach(struct proc* p, struct mm* mm)
+{
+    acquire(&mm->lock);
+    int slot = 0;
+    while (slot < MAXTHREAD && (mm->tslots & (1UL << slot)))
+        slot++;
+
+    // va=TRAPFRAME(slot), pa=p->trapframe, size=PGSIZE, perm=内核可读可写
+    if (slot == MAXTHREAD || mappages(mm->pagetable, TRAPFRAME(slot), PGSIZE, (uint64)p->trapframe, PTE_R | PTE_W) < 0) {
+        release(&mm->lock);
+        return -1;
+    }
+    mm->tslots |= 1UL << slot;
+    mm->ref++;
+    mm->live++;
+    release(&mm->lock);
+
+    p->mm = mm;
+    p->trapva = TRAPFRAME(slot);
+    p->pagetable = mm->pagetable;
+    p->kpagetable = mm->kpagetable;
+
+    // 槽位可能被已回收的线程使用过, 其他CPU上可能还缓存着旧的映射
+    uvmflush(mm->pagetable, p->trapva);
+    return 0;
+}
+
+// 线程p离开地址空间: 移除它的trapframe映射, 最后一个线程释放整个地址空间
+static void mmput(struct proc* p)
+{
+    struct mm* mm = p->mm;
+
+    acquire(&mm->lock);
+    uvmunmap(mm->pagetable, p->trapva, 1, false);
+    mm->tslots &= ~(1UL << ((TRAPFRAME(0) - p->trapva) / PGSIZE));
+    int ref = --mm->ref;
+    release(&mm->lock);
+
+    if (ref == 0)
+        mmfree(mm);
+}
+
+// 创建一个空的文件描述符表, 失败返回0
+static struct fdtable* fdtalloc(void)
+{
+    struct fdtable* fdt = kmem_cache_alloc(fdt_cache);
+    if (fdt == 0)
+        return 0;
+    memset(fdt, 0, sizeof(*fdt));
+    initlock(&fdt->lock, "fdtable");
+    fdt->ref = 1;
+    return fdt;
+}
+
+// 复制文件描述符表 (fork调用), 增加打开文件和工作目录的引用, 失败返回0
+static struct fdtable* fdtcopy(struct fdtable* fdt)
+{
+    struct fdtable* nfdt = fdtalloc();
+    if (nfdt == 0)
+        return 0;
+
+    acquire(&fdt->lock);
+    for (int i = 0; i < NOFILE; i++)
+        if (fdt->ofile[i])
+            nfdt->ofile[i] = filedup(fdt->ofile[i]);
+    nfdt->cwd = idup(fdt->cwd);
+    release(&fdt->lock);
+    return nfdt;
+}
+
+// 减少文件描述符表的引用, 最后一个引用关闭所有文件并释放工作目录
+static void fdtput(struct fdtable* fdt)
+{
+    acquire(&fdt->lock);
+    int ref = --fdt->ref;
+    release(&fdt->lock);
+    if (ref > 0)
+        return;
+
+    // 关闭所有文件描述符
+    for (int fd = 0; fd < NOFILE; fd++) {
+        if (fdt->ofile[fd]) {
+            fileclose(fdt->ofile[fd]);
+            fdt->ofile[fd] = 0;
+        }
+    }
+
+    // 释放工作目录
+    if (fdt->cwd) {
+        begin_op(); //* 事务开始
+        iput(fdt->cwd);
+        end_op(); //* 事务结束
+    }
+    kmem_cache_free(fdt_cache, fdt);
+}
+
+// 从空闲链表取出一个UNUSED进程, 空闲链表为空时分配新的进程结构体
+// 初始化内核运行所需的状态并返回 (持有p->lock的锁)
+// mm非空时新线程共享该地址空间 (clone), 否则创建新的地址空间
+// 如果进程数达到上限, 或内存分配失败, 返回0
+static struct proc* allocproc(struct mm* mm)
+{
+    struct proc* p;
+
+    acquire(&ptable.lock);
+    if ((p = ptable.free) != 0)
+        ptable.free = p->freenext;
+    release(&ptable.lock);
+    if (p == 0 && (p = procnew()) == 0)
+        return 0;
+
+    acquire(&p->lock); //* 获取进程锁
+    if (p->state != UNUSED)
+        panic("allocproc");
+
+    allocpid(p);     // 分配新的pid, 并加入pid哈希表
+    p->state = USED; // 更新状态为USED
 
     // 分配 trapframe 页
     if ((p->trapframe = (struct trapframe*)kalloc()) == 0) {
@@ -121,9 +414,11 @@ found:
         return 0;
     }
 
-    // 配置用户态页表 (trapframe数据页 trampoline代码段)
-    p->pagetable = proc_pagetable(p);
-    if (p->pagetable == 0) {
+    // 加入地址空间, 并将trapframe数据页映射到其中的一个槽位
+    struct mm* nmm = mm ? mm : mmalloc();
+    if (nmm == 0 || mmattach(p, nmm) < 0) {
+        if (mm == 0 && nmm)
+            mmfree(nmm);
         freeproc(p);
         release(&p->lock);
         return 0;
@@ -141,25 +436,43 @@ found:
 // 释放进程结构体和相关数据, 包括用户页 (需持有p->lock)
 static void freeproc(struct proc* p)
 {
+    // 离开地址空间, 最后一个线程释放用户页表和内核页表
+    if (p->mm)
+        mmput(p);
+    p->mm = 0;
+    p->trapva = 0;
+    p->pagetable = 0;
+    p->kpagetable = 0;
+
     // 释放 trapframe 页
     if (p->trapframe)
         kfree((void*)p->trapframe);
     p->trapframe = 0;
 
-    // 释放用户页表
-    if (p->pagetable)
-        proc_freepagetable(p->pagetable, p->sz);
+    // 移出pid哈希表
+    if (p->pid)
+        freepid(p);
 
     // 清空进程结构体
-    p->pagetable = 0;
-    p->sz = 0;
     p->pid = 0;
     p->parent = 0;
     p->name[0] = 0;
     p->chan = 0;
     p->killed = 0;
     p->xstate = 0;
+    p->nice = 0;
+    p->vruntime = 0;
+    p->rqcpu = 0;
+    p->tstamp = 0;
+    memset(&p->acct, 0, sizeof(p->acct));
+    memset(&p->cacct, 0, sizeof(p->cacct));
     p->state = UNUSED;
+
+    // 放回空闲链表, 调用者释放p->lock后才能被重新分配
+    acquire(&ptable.lock);
+    p->freenext = ptable.free;
+    ptable.free = p;
+    release(&ptable.lock);
 }
 
 // 用户虚拟内存布局 (proc.c->proc_pagetable)
@@ -169,13 +482,12 @@ static void freeproc(struct proc* p)
 //   fixed-size stack
 //   expandable heap
 //   ...
-//   TRAPFRAME (p->trapframe)
+//   TRAPFRAME(slot) (每个线程的p->trapframe, mmattach映射)
 //   TRAMPOLINE (内核代码段trampoline.S)
 // >高地址
 
-// 对于给定的进程创建一个用户页表
-// 暂时只有trampoline和trapframe页
-pagetable_t proc_pagetable(struct proc* p)
+// 创建一个用户页表, 暂时只有trampoline页
+pagetable_t proc_pagetable(void)
 {
     pagetable_t pagetable;
 
@@ -191,22 +503,16 @@ pagetable_t proc_pagetable(struct proc* p)
         return 0;
     }
 
-    // 映射 p->trapframe 数据页到 TRAMPLINE 的相邻低地址
-    // va=TRAPFRAME, pa=p->trapframe, size=PGSIZE, perm=内核可读可写
-    if (mappages(pagetable, TRAPFRAME, PGSIZE, (uint64)(p->trapframe), PTE_R | PTE_W) < 0) {
-        uvmunmap(pagetable, TRAMPOLINE, 1, 0);
-        uvmfree(pagetable, 0);
-        return 0;
-    }
-
     return pagetable;
 }
 
 // 释放进程的页表, 以及释放其引用的物理内存
-void proc_freepagetable(pagetable_t pagetable, uint64 sz)
+// trapva非零时同时移除该处的trapframe页映射
+void proc_freepagetable(pagetable_t pagetable, uint64 trapva, uint64 sz)
 {
     uvmunmap(pagetable, TRAMPOLINE, 1, 0); // 移除trampoline页映射
-    uvmunmap(pagetable, TRAPFRAME, 1, 0);  // 移除trapframe页映射
+    if (trapva)
+        uvmunmap(pagetable, trapva, 1, 0); // 移除trapframe页映射
     uvmfree(pagetable, sz);                // 释放用户页表及其物理内存
 }
 
@@ -229,12 +535,12 @@ void userinit(void)
     // 5. 配置用户态页表 (trapframe数据页 trampoline代码段)
     // 6. 设置swtch返回后跳转到forkret
     // 7. 设置内核栈指针 p->kstack + PGSIZE
-    p = allocproc();
+    p = allocproc(0);
     initproc = p;
 
     // 分配用户页填充initcode, 并映射到用户虚拟地址0
     uvmfirst(p->pagetable, initcode, sizeof(initcode));
-    p->sz = PGSIZE;
+    p->mm->sz = PGSIZE;
 
     // 从内核态到用户态的准备工作
     p->trapframe->epc = 0;     // 设置trapframe->epc指向initcode
@@ -242,40 +548,47 @@ void userinit(void)
 
     // 设置进程名和当前工作目录
     safestrcpy(p->name, "initcode", sizeof(p->name));
-    p->cwd = namei("/");
+    if ((p->fdt = fdtalloc()) == 0)
+        panic("userinit: fdtable");
+    p->fdt->cwd = namei("/");
 
-    // 更新状态为RUNNABLE, 等待调度
-    p->state = RUNNABLE;
+    // 更新状态为RUNNABLE, 加入运行队列等待调度
+    runqput(p);
 
     // 释放allocproc()中获取的进程锁
     release(&p->lock);
 }
 
 // sbrk() 的系统调用实现
-// 将用户内存增加或减少n字节
-int growproc(int n)
+// 将用户内存增加或减少n字节, 返回原来的内存大小, 失败返回-1
+// 持有mm->lock, 多个线程同时调用时各自得到不重叠的区间
+uint64 growproc(int n)
 {
-    uint64 sz;
-    struct proc* p = myproc();
+    struct mm* mm = myproc()->mm;
 
-    sz = p->sz;
+    acquire(&mm->lock);
+    uint64 oldsz = mm->sz;
+    uint64 sz = oldsz;
 
-    // 如果是增加
+    // 如果是增加, 只增加进程内存大小
+    // 物理页在首次访问时由vmfault分配
     if (n > 0) {
-        // oldsz=sz, newsz=sz+n, xperm=PTE_W
-        if ((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+        if (sz + n > MMAPBASE) {
+            release(&mm->lock);
             return -1;
         }
+        sz += n;
     }
 
     // 如果是减少
     else if (n < 0) {
-        sz = uvmdealloc(p->pagetable, sz, sz + n);
+        sz = uvmdealloc(mm->pagetable, sz, sz + n);
     }
 
     // 更新进程内存大小
-    p->sz = sz;
-    return 0;
+    mm->sz = sz;
+    release(&mm->lock);
+    return oldsz;
 }
 
 // 从父进程拷贝创建一个新的子进程
@@ -283,20 +596,38 @@ int growproc(int n)
 int fork(void)
 {
     struct proc* p = myproc();
+    struct fdtable* fdt; // 失败时由bad释放
 
     //* 分配新的空闲进程 (获取np->lock)
     struct proc* np;
-    if ((np = allocproc()) == 0)
+    if ((np = allocproc(0)) == 0)
         return -1;
 
-    // 将父进程的用户内存 复制到子进程
-    if (uvmcopy(p->pagetable, np->pagetable, p->sz) < 0) {
+    // 复制文件描述符表, 增加对已打开文件和工作目录的引用计数
+    // 在复制内存映射之前完成, 映射复制之后不再有会失败的步骤 (freeproc不撤销映射)
+    if ((np->fdt = fdtcopy(p->fdt)) == 0) {
         freeproc(np);
         release(&np->lock);
         return -1;
     }
 
-    np->sz = p->sz;
+    // 将父进程的用户内存和内存映射 复制到子进程
+    // 持有父进程的mm->lock, 其他线程不能同时修改父进程的页表
+    acquire(&p->mm->lock);
+    if (uvmcopy(p->pagetable, np->pagetable, p->mm->sz) < 0) {
+        release(&p->mm->lock);
+        goto bad;
+    }
+    np->mm->sz = p->mm->sz;
+    int err = mmapfork(p, np);
+    release(&p->mm->lock);
+    if (err < 0)
+        goto bad;
+
+    // 继承父进程的nice值和vruntime, 子进程不会因为刚创建而获得优势
+    np->nice = p->nice;
+    np->vruntime = p->vruntime;
+    np->rqcpu = p->rqcpu;
 
     // 拷贝trapframe数据页
     *(np->trapframe) = *(p->trapframe);
@@ -304,12 +635,6 @@ int fork(void)
     // 设置子进程fork的返回值为0
     np->trapframe->a0 = 0;
 
-    // 增加对已打开文件描述符的引用计数
-    for (int i = 0; i < NOFILE; i++)
-        if (p->ofile[i])
-            np->ofile[i] = filedup(p->ofile[i]);
-    np->cwd = idup(p->cwd);
-
     // 拷贝进程名
     safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -319,29 +644,87 @@ int fork(void)
 
     // 设置子进程的父进程
     acquire(&wait_lock);
-    np->parent = p;
+    childadd(p, np);
     release(&wait_lock);
 
-    // 更新子进程状态为RUNNABLE, 等待调度
+    // 更新子进程状态为RUNNABLE, 加入运行队列等待调度
     acquire(&np->lock);
-    np->state = RUNNABLE;
+    runqput(np);
     release(&np->lock);
 
     // 父进程返回子进程pid
     return pid;
+
+bad:
+    fdt = np->fdt;
+    np->fdt = 0;
+    freeproc(np);
+    release(&np->lock);
+    fdtput(fdt); // 关闭文件可能休眠, 在释放np->lock之后
+    return -1;
+}
+
+// 创建一个与当前进程共享地址空间和文件描述符表的线程
+// 新线程从fn(arg)开始执行, 使用用户栈stack, 有自己的trapframe和内核栈
+// 返回新线程的tid (即pid), 失败返回-1
+int clone(uint64 fn, uint64 arg, uint64 stack)
+{
+    struct proc* p = myproc();
+
+    //* 分配新的空闲进程, 加入当前地址空间 (获取np->lock)
+    struct proc* np;
+    if ((np = allocproc(p->mm)) == 0)
+        return -1;
+
+    // 共享文件描述符表
+    acquire(&p->fdt->lock);
+    p->fdt->ref++;
+    release(&p->fdt->lock);
+    np->fdt = p->fdt;
+
+    // 继承nice值和vruntime
+    np->nice = p->nice;
+    np->vruntime = p->vruntime;
+    np->rqcpu = p->rqcpu;
+
+    // 从fn(arg)开始执行, fn返回时跳转到地址0, 因此fn必须调用exit结束线程
+    *(np->trapframe) = *(p->trapframe);
+    np->trapframe->epc = fn;
+    np->trapframe->a0 = arg;
+    np->trapframe->sp = stack;
+    np->trapframe->ra = 0;
+
+    safestrcpy(np->name, p->name, sizeof(p->name));
+
+    int tid = np->pid;
+
+    release(&np->lock); //* 释放新线程锁
+
+    // 新线程的父进程是创建者, 但只能由join回收, wait会跳过它
+    acquire(&wait_lock);
+    childadd(p, np);
+    release(&wait_lock);
+
+    acquire(&np->lock);
+    runqput(np);
+    release(&np->lock);
+
+    return tid;
 }
 
 // 将p的弃子交给init (调用者必须持有wait_lock)
+// 只访问p的子进程链表, 与系统中的进程总数无关
 void reparent(struct proc* p)
 {
-    struct proc* pp;
+    if (p->children == 0)
+        return;
 
-    for (pp = proc; pp < &proc[NPROC]; pp++) {
-        if (pp->parent == p) {
-            pp->parent = initproc;
-            wakeup(initproc);
-        }
+    struct proc* pp;
+    while ((pp = p->children) != 0) {
+        childdel(pp);
+        childadd(initproc, pp);
     }
+    wakeup(initproc);
 }
 
 // 退出当前进程, 不会返回
@@ -354,20 +737,17 @@ void exit(int status)
     if (p == initproc)
         panic("init exiting");
 
-    // 关闭所有文件描述符
-    for (int fd = 0; fd < NOFILE; fd++) {
-        if (p->ofile[fd]) {
-            struct file* f = p->ofile[fd];
-            fileclose(f);
-            p->ofile[fd] = NULL;
-        }
-    }
+    // 最后一个退出的线程移除所有内存映射, 写回共享映射的脏页
+    // 页表本身在最后一个线程被回收时释放 (freeproc->mmput)
+    acquire(&p->mm->lock);
+    int last = --p->mm->live == 0;
+    release(&p->mm->lock);
+    if (last)
+        munmapall(p);
 
-    // 释放工作目录
-    begin_op(); //* 事务开始
-    iput(p->cwd);
-    end_op(); //* 事务结束
-    p->cwd = 0;
+    // 释放文件描述符表, 最后一个线程关闭所有文件并释放工作目录
+    fdtput(p->fdt);
+    p->fdt = 0;
 
     // 获取等待锁
     acquire(&wait_lock);
@@ -375,8 +755,9 @@ void exit(int status)
     // 将p的弃子交给init
     reparent(p);
 
-    // 唤醒父进程
+    // 唤醒父进程, 以及在join中等待的同一地址空间的线程
     wakeup(p->parent);
+    wakeup(p->mm);
 
     acquire(&p->lock);
     p->xstate = status; // 记录退出状态位
@@ -392,41 +773,44 @@ void exit(int status)
 // 保存退出状态并返回其 pid
 // 如果没有子进程，则返回 -1
 // addr: 存储子进程退出状态
-int wait(uint64 addr)
+int wait(uint64 addr) { return waitpid(-1, addr, 0); }
+
+// 等待子进程pid退出 (pid为-1时等待任意子进程)
+// 保存退出状态到addr并返回其pid, 没有这样的子进程或被终止时返回-1
+// options含WNOHANG时, 子进程都没有退出则立即返回0
+// 只遍历p的子进程链表 (跳过由join回收的线程), pid>0时通过pid哈希表直接查找
+int waitpid(int pid, uint64 addr, int options)
 {
     struct proc* pp;
-    int havekids, pid;
+    int havekids;
     struct proc* p = myproc();
 
+    if (pid == 0 || pid < -1)
+        return -1;
+
     acquire(&wait_lock); // 获取等待锁
 
     for (;;) {
         havekids = 0;
 
-        // 遍历所有进程, 寻找p的子进程
-        for (pp = proc; pp < &proc[NPROC]; pp++) {
-            if (pp->parent == p) {
+        if (pid > 0) {
+            // 持有wait_lock, 子进程不会被其他线程同时回收或改变父进程
+            if ((pp = pidlookup(pid)) != 0) {
+                if (pp->parent == p && pp->mm != p->mm) {
+                    havekids = 1;
+                    if (pp->state == ZOMBIE)
+                        goto found;
+                }
+                release(&pp->lock);
+            }
+        } else {
+            for (pp = p->children; pp != 0; pp = pp->sibling) {
+                if (pp->mm == p->mm)
+                    continue;
                 acquire(&pp->lock); // 获取子进程锁
                 havekids = 1;       // 标记存在子进程
-
-                // 如果子进程已经退出, 则释放子进程资源
-                if (pp->state == ZOMBIE) {
-                    pid = pp->pid;
-
-                    // 从内核地址xstate 复制数据到 用户地址addr
-                    if (addr != 0 && copyout(p->pagetable, addr, (char*)&pp->xstate, sizeof(pp->xstate)) < 0) {
-                        release(&pp->lock);
-                        release(&wait_lock);
-                        return -1;
-                    }
-
-                    // 释放子进程所有资源
-                    freeproc(pp);
-
-                    release(&pp->lock);
-                    release(&wait_lock);
-                    return pid;
-                }
+                if (pp->state == ZOMBIE)
+                    goto found;
                 release(&pp->lock);
             }
         }
@@ -437,48 +821,288 @@ int wait(uint64 addr)
             return -1;
         }
 
+        // 子进程都没有退出, 不等待
+        if (options & WNOHANG) {
+            release(&wait_lock);
+            return 0;
+        }
+
         // 等待子进程退出
         sleep(p, &wait_lock);
     }
+
+found:
+    // 子进程已经退出 (持有pp->lock), 释放子进程资源
+    pid = pp->pid;
+
+    // 从内核地址xstate 复制数据到 用户地址addr
+    if (addr != 0 && copyout(p->pagetable, addr, (char*)&pp->xstate, sizeof(pp->xstate)) < 0) {
+        release(&pp->lock);
+        release(&wait_lock);
+        return -1;
+    }
+
+    // 子进程及其已回收后代的统计计入p->cacct
+    acctadd(&p->cacct, &pp->acct);
+    acctadd(&p->cacct, &pp->cacct);
+
+    // 释放子进程所有资源
+    childdel(pp);
+    freeproc(pp);
+
+    release(&pp->lock);
+    release(&wait_lock);
+    return pid;
+}
+
+// 等待同一地址空间中的线程tid退出, 回收它并将退出状态写入addr
+// 任何线程都可以回收同一地址空间中的其他线程, 不要求是创建者
+// 成功返回tid, 没有这样的线程或被终止时返回-1
+int join(int tid, uint64 addr)
+{
+    struct proc* p = myproc();
+
+    acquire(&wait_lock);
+    for (;;) {
+        if (killed(p)) {
+            release(&wait_lock);
+            return -1;
+        }
+
+        // 持有wait_lock, pp不会被其他线程同时回收
+        struct proc* pp = pidlookup(tid);
+        if (pp == 0 || pp == p || pp->mm != p->mm) {
+            if (pp)
+                release(&pp->lock);
+            release(&wait_lock);
+            return -1;
+        }
+
+        if (pp->state == ZOMBIE) {
+            if (addr != 0 && copyout(p->pagetable, addr, (char*)&pp->xstate, sizeof(pp->xstate)) < 0) {
+                release(&pp->lock);
+                release(&wait_lock);
+                return -1;
+            }
+            // 线程的统计并入回收者, 使RUSAGE_SELF和父进程看到整个进程
+            acctadd(&p->acct, &pp->acct);
+            acctadd(&p->cacct, &pp->cacct);
+            childdel(pp);
+            freeproc(pp);
+            release(&pp->lock);
+            release(&wait_lock);
+            return tid;
+        }
+        release(&pp->lock);
+
+        // 线程退出时在p->mm上唤醒 (exit)
+        sleep(p->mm, &wait_lock);
+    }
+}
+
+static void runqkick(int self);
+
+// 将进程p设置为RUNNABLE, 并按vruntime插入当前CPU的运行队列 (需持有p->lock)
+// 锁顺序: p->lock 先于 runq.lock
+void runqput(struct proc* p)
+{
+    int id = cpuid();
+    struct runq* rq = &runqs[id];
+
+    p->state = RUNNABLE;
+    p->weight = nice2weight[p->nice - NICE_MIN];
+
+    acquire(&rq->lock);
+
+    // vruntime换算为以本队列的minvrt为参照
+    if (p->rqcpu != id) {
+        p->vruntime = p->vruntime - runqs[p->rqcpu].minvrt + rq->minvrt;
+        p->rqcpu = id;
+    }
+
+    // 休眠较久的进程不能积累过多的vruntime优势
+    if (VRT_BEFORE(p->vruntime, rq->minvrt - SCHED_WAKEUP))
+        p->vruntime = rq->minvrt - SCHED_WAKEUP;
+
+    // 插入到vruntime不小于它的第一个进程之前, 相同vruntime保持先进先出
+    struct proc** pp = &rq->head;
+    while (*pp && !VRT_BEFORE(p->vruntime, (*pp)->vruntime))
+        pp = &(*pp)->rqnext;
+    p->rqnext = *pp;
+    *pp = p;
+
+    rq->n++;
+    rq->load += p->weight;
+    int n = rq->n;
+    release(&rq->lock);
+
+    // 本CPU正在运行其他进程, 或者队列中不止一个进程时, 唤醒一个空闲CPU来窃取
+    // yield让出的进程会被本CPU重新选择, 不需要唤醒其他CPU
+    struct proc* cur = mycpu()->proc;
+    if ((cur != 0 && cur != p) || n > 1)
+        runqkick(id);
+}
+
+// 通过核间中断唤醒一个空闲的CPU (不包括CPU self)
+// 空闲CPU在wfi前设置cpu.idle, 被唤醒后由调度器窃取进程
+static void runqkick(int self)
+{
+    for (int i = 0; i < NCPU; i++) {
+        if (i == self || cpus[i].idle == 0)
+            continue;
+        // 清除idle标志, 保证每个空闲CPU只被唤醒一次
+        if (__sync_lock_test_and_set(&cpus[i].idle, 0)) {
+            *(volatile uint32*)CLINT_MSIP(i) = 1;
+            return;
+        }
+    }
+}
+
+// 从运行队列rq的队首取出一个进程 (需持有rq->lock)
+static struct proc* runqpop(struct runq* rq)
+{
+    struct proc* p = rq->head;
+    rq->head = p->rqnext;
+    p->rqnext = 0;
+    rq->n--;
+    rq->load -= p->weight;
+    return p;
+}
+
+// 从本地运行队列rq取出vruntime最小的进程, 队列为空时返回0
+static struct proc* runqget(struct runq* rq)
+{
+    // 不加锁检查队列是否为空, 避免无谓地获取锁
+    if (rq->n == 0)
+        return 0;
+
+    acquire(&rq->lock);
+    struct proc* p = 0;
+    if (rq->head) {
+        p = runqpop(rq);
+        if (VRT_BEFORE(rq->minvrt, p->vruntime))
+            rq->minvrt = p->vruntime;
+    }
+    release(&rq->lock);
+    return p;
+}
+
+// 从其他CPU的运行队列victim窃取一个进程到CPU id, 不需要窃取时返回0
+// 本地队列为空时, 只要victim不为空就窃取
+// 否则只有负载差大于迁移进程的权重时才窃取 (迁移后负载差变小), 避免进程来回迁移
+static struct proc* runqsteal(struct runq* victim, int id)
+{
+    struct runq* rq = &runqs[id];
+    struct proc* p = 0;
+
+    acquire(&victim->lock);
+    if (victim->head && (rq->n == 0 || victim->load > rq->load + victim->head->weight)) {
+        p = runqpop(victim);
+
+        // vruntime换算为以本地队列的minvrt为参照
+        p->vruntime = p->vruntime - victim->minvrt + rq->minvrt;
+        p->rqcpu = id;
+    }
+    release(&victim->lock);
+    return p;
+}
+
+// 为CPU id选择下一个运行的进程, 没有可运行的进程时返回0
+// 开销与进程总数无关: 只比较各CPU队列的负载, 并取队首
+static struct proc* runqpick(int id)
+{
+    struct runq* rq = &runqs[id];
+    struct proc* p = 0;
+
+    // 找出负载最重的其他队列 (不加锁读取)
+    struct runq* busiest = 0;
+    for (int i = 1; i < NCPU; i++) {
+        struct runq* q = &runqs[(id + i) % NCPU];
+        if (q->n > 0 && (busiest == 0 || q->load > busiest->load))
+            busiest = q;
+    }
+
+    // 需要平衡负载时从最重的队列窃取, 否则取本地队列
+    if (busiest && (p = runqsteal(busiest, id)) != 0)
+        rq->steal++;
+    else
+        p = runqget(rq);
+
+    if (p)
+        rq->nrun++;
+    return p;
 }
 
 // 进程的总调度循环体
 // 每个CPU从 main.c 跳转到此处 (S-mode)
+// 每次从运行队列取出一个进程运行, 不再遍历整个进程表
 void scheduler(void)
 {
     struct proc* p;
     struct cpu* c = mycpu();
+    int id = cpuid(); // 调度器线程固定在当前CPU上运行
 
     c->proc = 0;
     for (;;) {
         intr_on(); // 启用设备中断 (防止死锁)
 
-        // 遍历寻找可运行进程
-        int found = 0;
-        for (p = proc; p < &proc[NPROC]; p++) {
-            acquire(&p->lock); //* 获取进程锁
-
-            // 如果进程是RUNNABLE状态
-            if (p->state == RUNNABLE) {
-                p->state = RUNNING;
-                c->proc = p;
-
-                // 由进程负责释放锁 并在返回到调度器之前重新获取锁
-                // 将当前调度器状态保存到cpu, 并切换到进程p
-                swtch(&c->context, &p->context);
-
-                // 进程执行完毕, 返回到调度器 (持有p->lock)
-                c->proc = 0;
-                found = 1;
+        // 如果没有可运行的进程
+        // 先利用空闲时间填充预清零页池, 池满后再等待中断
+        if ((p = runqpick(id)) == 0) {
+            if (kzero_idle() != 0)
+                continue;
+
+            // 关闭中断后标记为空闲, 再检查一次运行队列
+            // 此后加入的进程一定会通过核间中断唤醒此CPU (runqkick)
+            // 中断关闭时wfi仍会因为待处理的中断而返回
+            intr_off();
+            c->idle = 1;
+            __sync_synchronize();
+            if ((p = runqpick(id)) == 0) {
+                timerset(false);     // tickless: 只在最近的睡眠截止时间唤醒
+                asm volatile("wfi"); // Wait For Interrupt
             }
-            release(&p->lock); //* 释放进程锁
+            c->idle = 0;
+            if (p == 0)
+                continue;
         }
 
-        // 如果没有找到可运行的进程
-        if (found == 0) {
-            intr_on();           // 启用设备中断
-            asm volatile("wfi"); // Wait For Interrupt
-        }
+        // 进程离开运行队列后仍为RUNNABLE状态
+        // 如果它刚在其他CPU上让出, 需要等那里的调度器释放p->lock
+        acquire(&p->lock); //* 获取进程锁
+        if (p->state != RUNNABLE)
+            panic("scheduler: not runnable");
+
+        p->state = RUNNING;
+        c->proc = p;
+
+        // 切换到进程的内核页表, 使内核可以通过用户窗口访问用户内存
+        kvmswitch(p);
+
+        // 开始新的时间片
+        c->sliceend = r_time() + TIMESLICE;
+        timerset(true);
+
+        // 由进程负责释放锁 并在返回到调度器之前重新获取锁
+        // 将当前调度器状态保存到cpu, 并切换到进程p
+        uint64 start = r_time();
+        p->tstamp = start;
+        TRACEPOINT(TR_SWITCH_IN, p->pid, 0);
+        swtch(&c->context, &p->context);
+        TRACEPOINT(TR_SWITCH_OUT, p->pid, p->state);
+
+        // 按权重累计虚拟运行时间, 权重越大增长越慢
+        // 进程总是在内核态让出CPU, 从上次记账到现在计为内核态时间
+        uint64 now = r_time();
+        p->vruntime += (now - start) * NICE0_WEIGHT / p->weight;
+        p->acct.stime += now - p->tstamp;
+
+        // 进程执行完毕, 返回到调度器 (持有p->lock)
+        // 切换回全局内核页表, 因为进程的内核页表可能随后被释放
+        kvmswitch(0);
+        c->proc = 0;
+
+        release(&p->lock); //* 释放进程锁
     }
 }
 
@@ -512,7 +1136,8 @@ void yield(void)
 {
     struct proc* p = myproc();
     acquire(&p->lock); // *
-    p->state = RUNNABLE;
+    p->acct.nivcsw++;
+    runqput(p);
     sched();
     release(&p->lock); // *
 }
@@ -542,67 +1167,152 @@ void forkret(void)
     usertrapret();
 }
 
+// 返回chan所在的休眠队列桶
+static struct sleepq* sleepq(void* chan)
+{
+    uint64 h = (uint64)chan;
+    return &sleepqs[(h ^ (h >> 6) ^ (h >> 12)) % NSLEEPQ];
+}
+
 // 释放锁lk 并在chan上休眠, 醒来时重新获取锁
 void sleep(void* chan, struct spinlock* lk)
 {
     struct proc* p = myproc();
+    struct sleepq* sq = sleepq(chan);
 
-    // 必须持有p->lock才能修改p->state
-    acquire(&p->lock);
-    release(lk);
+    // 锁顺序: lk 先于 sq->lock 先于 p->lock
+    acquire(&sq->lock);
+    acquire(&p->lock); // 必须持有p->lock才能修改p->state
+
+    // 加入队尾, 使wakeone先唤醒等待最久的进程
+    p->sqnext = 0;
+    p->sqprev = sq->tail;
+    if (sq->tail)
+        sq->tail->sqnext = p;
+    else
+        sq->head = p;
+    sq->tail = p;
 
     // 更新为SLEEPING状态
     p->chan = chan;
     p->state = SLEEPING;
+    p->acct.nvcsw++;
+    TRACEPOINT(TR_SLEEP, chan, 0);
+
+    // 入队并更新状态之后才释放lk, 之后持有lk的wakeup一定能在队列中找到此进程
+    release(lk);
+    release(&sq->lock);
 
     // 进行调度 (持有p->lock)
     sched();
 
-    // 唤醒后重新获取lk
+    // 唤醒后由进程自己移出休眠队列
+    // 在此之前wakeup会看到此进程, 但它已不是SLEEPING状态, 因此会被跳过
     p->chan = 0;
     release(&p->lock);
+
+    acquire(&sq->lock);
+    if (p->sqprev)
+        p->sqprev->sqnext = p->sqnext;
+    else
+        sq->head = p->sqnext;
+    if (p->sqnext)
+        p->sqnext->sqprev = p->sqprev;
+    else
+        sq->tail = p->sqprev;
+    release(&sq->lock);
+
+    // 重新获取lk
     acquire(lk);
 }
 
-// 唤醒所有在chan上休眠的进程
-// 必须在没有任何p->lock的情况下调用
-void wakeup(void* chan)
+// 唤醒至多max个在chan上休眠的进程, max为0时唤醒全部
+// 返回唤醒的进程数
+int wakeupn(void* chan, int max)
 {
+    struct sleepq* sq = sleepq(chan);
     struct proc* p;
+    int n = 0;
+
+    // 休眠者入队之后才释放lk, 而唤醒者在修改条件时持有lk (获取lk之后读取),
+    // 因此不加锁读到空队列时, 不会丢失唤醒
+    if (__atomic_load_n(&sq->head, __ATOMIC_ACQUIRE) == 0)
+        return 0;
 
-    // 遍历所有进程, 启用所有在chan上休眠的进程
-    for (p = proc; p < &proc[NPROC]; p++) {
-        if (p != myproc()) {
-            acquire(&p->lock);
-            if (p->state == SLEEPING && p->chan == chan)
-                p->state = RUNNABLE;
-            release(&p->lock);
+    // 只检查同一个桶中的进程
+    acquire(&sq->lock);
+    for (p = sq->head; p != 0 && (max == 0 || n < max); p = p->sqnext) {
+        if (p == myproc())
+            continue;
+        acquire(&p->lock);
+        if (p->state == SLEEPING && p->chan == chan) {
+            runqput(p);
+            n++;
         }
+        release(&p->lock);
     }
+    release(&sq->lock);
+    if (n > 0)
+        TRACEPOINT(TR_WAKEUP, chan, n);
+    return n;
 }
 
+// 唤醒所有在chan上休眠的进程
+// 必须在没有任何p->lock的情况下调用
+void wakeup(void* chan) { wakeupn(chan, 0); }
+
+// 只唤醒一个在chan上休眠的进程 (等待最久的), 避免惊群
+// 被唤醒者如果没有消耗掉条件, 需要自己继续唤醒下一个
+void wakeone(void* chan) { wakeupn(chan, 1); }
+
 // 终止给定pid的进程
 int kill(int pid)
 {
-    struct proc* p;
+    // 通过pid哈希表查找 (持有p->lock)
+    struct proc* p = pidlookup(pid);
+    if (p == 0)
+        return -1;
 
-    // 遍历所有进程, 查找pid
-    for (p = proc; p < &proc[NPROC]; p++) {
-        acquire(&p->lock);
-        if (p->pid == pid) {
-            // 设置killed标志
-            p->killed = 1;
+    // 设置killed标志
+    p->killed = 1;
 
-            // 唤醒如果在睡眠的进程
-            if (p->state == SLEEPING)
-                p->state = RUNNABLE;
+    // 唤醒如果在睡眠的进程
+    if (p->state == SLEEPING)
+        runqput(p);
 
-            release(&p->lock);
-            return 0;
-        }
-        release(&p->lock);
-    }
-    return -1;
+    release(&p->lock);
+    return 0;
+}
+
+// 设置进程pid的nice值 (pid为0表示当前进程), 成功返回0, 失败返回-1
+// 新的权重在进程下次加入运行队列时生效
+int setnice(int pid, int nice)
+{
+    if (nice < NICE_MIN || nice > NICE_MAX)
+        return -1;
+    if (pid == 0)
+        pid = myproc()->pid;
+
+    struct proc* p = pidlookup(pid);
+    if (p == 0)
+        return -1;
+    p->nice = nice;
+    release(&p->lock);
+    return 0;
+}
+
+// 读取进程pid的nice值到*nice (pid为0表示当前进程), 成功返回0, 失败返回-1
+int getnice(int pid, int* nice)
+{
+    if (pid == 0)
+        pid = myproc()->pid;
+
+    struct proc* p = pidlookup(pid);
+    if (p == 0)
+        return -1;
+    *nice = p->nice;
+    release(&p->lock);
+    return 0;
 }
 
 // 设置进程p的killed标志为1
@@ -673,8 +1383,8 @@ void procdump(void)
         [ZOMBIE] "zombie"
     };
 
-    printf("\n");
-    for (struct proc* p = proc; p < &proc[NPROC]; p++) {
+    printf("\nproc: %d allocated\n", ptable.n);
+    for (struct proc* p = ptable.all; p != 0; p = p->allnext) {
         if (p->state == UNUSED)
             continue;
 
@@ -684,7 +1394,27 @@ void procdump(void)
         else
             state = "???";
 
-        printf("%d %s %s", p->pid, state, p->name);
+        // 时间以毫秒为单位, csw为主动/被动让出CPU的次数
+        struct pacct* a = &p->acct;
+        printf("%d %s %s user %lums sys %lums csw %lu/%lu syscall %lu fault %lu", p->pid, state, p->name,
+            a->utime / (TIMEBASE / 1000), a->stime / (TIMEBASE / 1000), a->nvcsw, a->nivcsw, a->nsyscall,
+            a->nfault);
         printf("\n");
     }
+
+    // 打印运行队列和中断统计
+    for (int i = 0; i < NCPU; i++) {
+        struct runq* rq = &runqs[i];
+        if (rq->nrun > 0)
+            printf("runq: cpu%d len %d run %lu steal %lu timer %lu ipi %lu\n", i, rq->n, rq->nrun, rq->steal,
+                cpus[i].ntimer, cpus[i].nipi);
+    }
+
+    kallocdump(); // 打印物理页分配统计
+    tlbdump();    // 打印TLB刷新统计
+    slabdump();   // 打印slab缓存统计
+    timerdump();  // 打印定时器统计
+    lockdump();   // 打印自旋锁竞争统计
+    profdump();   // 打印采样统计
+    tracedump();  // 打印事件跟踪统计
 }
@@ -25,6 +25,12 @@ struct cpu {
     struct context context; // 当前保存的调度器上下文 scheduler() <proc.c>
     int off_num;            // 中断禁用的次数 (push_off增加计数 pop_off减少计数)
     int intr_enable;        // 中断在 push_off 之前是否被启用
+    int idle;               // 正在wfi等待, 有新进程时需要核间中断唤醒 (proc.c->runqkick)
+    uint64 sliceend;        // 当前时间片结束的time寄存器值 (proc.c->scheduler)
+
+    uint64 ntimer; // 定时器中断次数
+    uint64 nipi;   // 收到的核间中断次数
+    uint64 trapfp; // 内核态陷入时被中断代码的帧指针 (trap.c->kerneltrap, 采样分析器回溯内核栈)
 };
 
 extern struct cpu cpus[NCPU];
@@ -70,8 +76,53 @@ struct trapframe {
     /* 280 */ uint64 t6;
 };
 
+// 虚拟内存区域 (mmap.c)
+struct vma {
+    uint64 addr;    // 起始虚拟地址 (页对齐)
+    uint64 len;     // 长度 (页对齐), 为0表示空闲
+    int prot;       // PROT_READ | PROT_WRITE | PROT_EXEC
+    int flags;      // MAP_SHARED | MAP_PRIVATE | MAP_ANONYMOUS
+    struct file* f; // 映射的文件, 匿名映射为NULL
+    uint64 off;     // addr对应的文件偏移
+};
+
+// 地址空间, 由共享它的所有线程引用 (proc.c->clone)
+struct mm {
+    struct spinlock lock;   // 保护下述变量, 以及页错误, sbrk, mmap对页表的修改
+    int ref;                // 引用此地址空间的线程数 (包括尚未回收的ZOMBIE)
+    int live;               // 尚未退出的线程数, 降为0时移除所有内存映射
+    uint64 tslots;          // 已占用的trapframe槽位 (位图, memlayout.h->TRAPFRAME)
+    uint64 sz;              // 进程内存大小(字节)
+    pagetable_t pagetable;  // 用户页表
+    pagetable_t kpagetable; // 内核页表 (共享内核映射, 并包含用户窗口)
+    struct vma vma[NVMA];   // 内存映射区域
+
+    // 不需要持有lock
+    uint64 asid;     // ASID分配 (代数<<16 | 编号), 由scheduler设置 (vm.c)
+    uint64 tlbstale; // 可能缓存了过时TLB项的CPU集合 (原子操作)
+};
+
+// 文件描述符表, 由共享它的所有线程引用 (proc.c->clone)
+struct fdtable {
+    struct spinlock lock;       // 保护下述变量
+    int ref;                    // 引用计数
+    struct file* ofile[NOFILE]; // 打开的文件
+    struct minode* cwd;         // 工作目录
+};
+
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// 进程的CPU时间和事件统计 (getrusage)
+// 用户态与内核态的边界在trap.c->usertrap/usertrapret, 调度在proc.c->scheduler
+struct pacct {
+    uint64 utime;    // 用户态时间 (time周期数)
+    uint64 stime;    // 内核态时间 (time周期数)
+    uint64 nvcsw;    // 主动让出CPU的次数 (sleep)
+    uint64 nivcsw;   // 被动让出CPU的次数 (yield)
+    uint64 nsyscall; // 系统调用次数
+    uint64 nfault;   // 页错误次数 (vm.c->vmfault)
+};
+
 // 每个进程的状态
 struct proc {
     struct spinlock lock;
@@ -82,17 +133,43 @@ struct proc {
     int killed;           // 如果非零, 则进程已被终止
     int xstate;           // 退出状态, 将返回给父进程的 wait
     int pid;              // Process ID
+    int nice;             // nice值 (-20~19), 越小分到的CPU时间越多
 
     // 当使用下述变量时必须持有wait_lock
-    struct proc* parent; // 父进程
+    struct proc* parent;    // 父进程
+    struct proc* children;  // 第一个子进程 (包括由join回收的线程)
+    struct proc* sibling;   // 父进程的子进程链表中的下一个
+    struct proc** psibling; // 指向前一个兄弟的sibling (或父进程的children)
+
+    // 当使用下述变量时必须持有pid_lock (proc.c->pidhash)
+    struct proc* pidnext; // pid哈希桶中的下一个进程
+
+    // 当使用下述变量时必须持有ptable.lock (proc.c->ptable)
+    struct proc* freenext; // 空闲链表中的下一个进程结构体
+    struct proc* allnext;  // 所有进程结构体链表中的下一个 (设置后不再改变, 可以不加锁遍历)
+
+    // 当使用下述变量时必须持有所在运行队列的锁 (proc.c->runqs)
+    // 进程运行时由所在CPU的调度器独占
+    struct proc* rqnext; // 运行队列中的下一个进程
+    uint64 vruntime;     // 按权重缩放的虚拟运行时间 (time周期数)
+    int weight;          // 加入运行队列时nice值对应的权重
+    int rqcpu;           // vruntime所参照的运行队列
+
+    // 当使用下述变量时必须持有所在休眠队列的锁 (proc.c->sleepqs)
+    struct proc* sqnext; // 休眠队列中的下一个进程
+    struct proc* sqprev; // 休眠队列中的上一个进程
 
     // 下述变量是进程私有的, 所以不需要持有p->lock
     uint64 kstack;               // 内核栈的虚拟地址
-    uint64 sz;                   // 进程内存大小(字节)
-    pagetable_t pagetable;       // 用户页表
+    struct mm* mm;               // 地址空间 (线程之间共享)
+    struct fdtable* fdt;         // 文件描述符表 (线程之间共享)
+    pagetable_t pagetable;       // 即mm->pagetable (exec只在地址空间不共享时替换)
+    pagetable_t kpagetable;      // 即mm->kpagetable
     struct trapframe* trapframe; // data page for trampoline.S
+    uint64 trapva;               // trapframe在用户页表中的虚拟地址 (每个线程一个槽位)
     struct context context;      // 进程上下文
-    struct file* ofile[NOFILE];  // 文件描述符表
-    struct minode* cwd;          // 工作目录
+    uint64 tstamp;               // 上次记账时的time寄存器值
+    struct pacct acct;           // 本线程的统计 (包括已经join回收的线程)
+    struct pacct cacct;          // 已经wait回收的子进程的统计之和
     char name[16];               // 进程名
 };
\ No newline at end of file
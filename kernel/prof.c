@@ -0,0 +1,192 @@
+// 采样分析器
+//
+// 开启后, 每个CPU运行进程时按采样频率产生定时器中断 (trap.c->timerset)
+// 每次中断记录被中断的PC, 当前进程和特权级, 内核态时沿帧指针回溯内核栈 (-fno-omit-frame-pointer)
+// 样本放入每个CPU的环形缓冲区, 用户程序读取设备文件/dev/prof取出 (user/prof.c)
+// 写入十进制的采样频率开始采样, 写入0停止
+//
+// 空闲的CPU不会为采样而唤醒, 因此样本只反映运行进程和调度器的时间
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+#include "defs.h"
+#include "prof.h"
+
+#define NPROFSAMPLE 256 // 每个CPU环形缓冲区的样本数
+
+// 每个CPU的采样状态
+struct profcpu {
+    struct spinlock lock;
+    uint64 next;    // 下一次采样的time寄存器值
+    uint head;      // 写入位置 (单调增加, 取模使用)
+    uint tail;      // 读取位置
+    uint64 nsample; // 记录的样本数
+    uint64 ndrop;   // 缓冲区满时丢弃的样本数
+    struct profsample ring[NPROFSAMPLE];
+} profcpus[NCPU];
+
+static uint64 profinterval; // 采样间隔 (time周期数), 0表示未开启
+
+// 沿帧指针回溯内核栈, 返回记录的返回地址数
+// fp是被中断代码的帧指针 (trap.c->kerneltrap记录), 只在同一个栈页内回溯
+// 栈帧布局: fp-8为返回地址, fp-16为上一个帧指针
+// 栈顶的帧 (usertrap, forkret, start) 保存的是用户态或entry.S留下的值, 不再回溯
+// 帧指针必须严格增大, 否则是损坏的链 (例如entry.S未设置的s0=0)
+static int profunwind(uint64 fp, uint64* stack)
+{
+    if (fp == 0)
+        return 0;
+
+    uint64 lo = PGROUNDDOWN(fp - 1);
+    uint64 hi = lo + PGSIZE;
+    int depth = 0;
+
+    while (depth < PROFDEPTH && fp >= lo + 16 && fp < hi && (fp & 7) == 0) {
+        uint64 ra = *(uint64*)(fp - 8);
+        if (ra == 0)
+            break;
+        stack[depth++] = ra;
+
+        uint64 next = *(uint64*)(fp - 16);
+        if (next <= fp)
+            break;
+        fp = next;
+    }
+    return depth;
+}
+
+// 到达采样时间时记录一个样本
+// trap.c->clockintr 调用 (需关闭中断), sepc和sstatus仍是本次陷入的值
+void proftick(void)
+{
+    uint64 interval = profinterval;
+    if (interval == 0)
+        return;
+
+    struct cpu* c = mycpu();
+    struct profcpu* pc = &profcpus[cpuid()];
+    uint64 now = r_time();
+    if (now < pc->next)
+        return;
+    pc->next = now + interval;
+
+    acquire(&pc->lock);
+    if (pc->head - pc->tail == NPROFSAMPLE) {
+        pc->ndrop++;
+        release(&pc->lock);
+        return;
+    }
+
+    struct profsample* s = &pc->ring[pc->head % NPROFSAMPLE];
+    struct proc* p = c->proc;
+    s->pc = r_sepc();
+    s->pid = p ? p->pid : 0;
+    s->cpu = cpuid();
+    s->mode = (r_sstatus() & SSTATUS_SPP) ? PROF_KERNEL : PROF_USER;
+    safestrcpy(s->name, p ? p->name : "-", sizeof(s->name));
+    s->depth = s->mode == PROF_KERNEL ? profunwind(c->trapfp, s->stack) : 0;
+
+    pc->head++;
+    pc->nsample++;
+    release(&pc->lock);
+}
+
+// 返回当前CPU下一次采样的时间, 未开启时返回-1 (trap.c->timerset)
+uint64 profnext(void)
+{
+    if (profinterval == 0)
+        return -1;
+    return profcpus[cpuid()].next;
+}
+
+// 取出所有CPU缓冲区中的样本, 只返回完整的样本
+// 没有样本时返回0, 不等待
+static int profread(int user_dst, uint64 dst, int n)
+{
+    struct profsample s;
+    int tot = 0;
+
+    for (int i = 0; i < NCPU; i++) {
+        struct profcpu* pc = &profcpus[i];
+        while (tot + sizeof(s) <= n) {
+            acquire(&pc->lock);
+            if (pc->tail == pc->head) {
+                release(&pc->lock);
+                break;
+            }
+            s = pc->ring[pc->tail % NPROFSAMPLE];
+            pc->tail++;
+            release(&pc->lock);
+
+            // 拷贝到用户空间可能发生页错误, 因此不持有锁
+            if (either_copyout(user_dst, dst + tot, &s, sizeof(s)) < 0)
+                return tot > 0 ? tot : -1;
+            tot += sizeof(s);
+        }
+    }
+    return tot;
+}
+
+// 写入十进制的采样频率 (Hz), 0表示停止
+// 开始采样时清空缓冲区
+// 不含数字的写入(只有换行符)被忽略, echo分别写入参数和换行符
+static int profwrite(int user_src, uint64 src, int n)
+{
+    char buf[16];
+    if (n <= 0 || n >= sizeof(buf) || either_copyin(buf, user_src, src, n) < 0)
+        return -1;
+
+    int hz = 0, ndigit = 0;
+    for (int i = 0; i < n && buf[i] != '\n'; i++, ndigit++) {
+        if (buf[i] < '0' || buf[i] > '9')
+            return -1;
+        hz = hz * 10 + buf[i] - '0';
+        if (hz > PROFMAXHZ)
+            return -1;
+    }
+    if (ndigit == 0)
+        return n;
+
+    profinterval = 0;
+    __sync_synchronize();
+    if (hz > 0) {
+        for (int i = 0; i < NCPU; i++) {
+            struct profcpu* pc = &profcpus[i];
+            acquire(&pc->lock);
+            pc->head = pc->tail = 0;
+            pc->next = 0;
+            release(&pc->lock);
+        }
+
+        // 各CPU在下次设定定时器时按采样间隔中断, 最迟在当前时间片结束时
+        __sync_synchronize();
+        profinterval = TIMEBASE / hz;
+    }
+    return n;
+}
+
+void profinit(void)
+{
+    for (int i = 0; i < NCPU; i++)
+        initlock(&profcpus[i].lock, "prof");
+
+    devsw[PROF].read = profread;
+    devsw[PROF].write = profwrite;
+}
+
+// 打印每个CPU的采样统计 (procdump调用, 不使用锁)
+void profdump(void)
+{
+    for (int i = 0; i < NCPU; i++) {
+        struct profcpu* pc = &profcpus[i];
+        if (pc->nsample > 0 || pc->ndrop > 0)
+            printf("prof: cpu%d samples %lu dropped %lu\n", i, pc->nsample, pc->ndrop);
+    }
+}
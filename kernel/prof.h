@@ -0,0 +1,17 @@
+// 采样分析器的样本格式 (kernel/prof.c, user/prof.c, prof.py)
+#define PROFDEPTH 6   // 内核栈回溯的最大深度
+#define PROFMAXHZ 10000 // 最高采样频率
+
+#define PROF_USER 0   // 中断发生在用户态
+#define PROF_KERNEL 1 // 中断发生在内核态
+
+struct profsample {
+    uint64 pc;               // 被中断的PC
+    uint64 stack[PROFDEPTH]; // 内核态时沿帧指针回溯的返回地址, 由内向外
+    int pid;                 // 当前进程, 调度器中为0
+    uchar cpu;               // 采样的CPU
+    uchar mode;              // PROF_USER或PROF_KERNEL
+    uchar depth;             // stack中有效的返回地址数
+    uchar pad;
+    char name[16]; // 进程名
+};
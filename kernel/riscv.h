@@ -35,6 +35,7 @@ static inline void w_mepc(uint64 x) {
 // 全局状态
 // Supervisor Status Register, sstatus
 
+#define SSTATUS_SUM (1L << 18)  // Supervisor User Memory access
 #define SSTATUS_SPP (1L << 8)   // Previous mode, 1=Supervisor, 0=User
 #define SSTATUS_SPIE (1L << 5)  // Supervisor Previous Interrupt Enable
 #define SSTATUS_UPIE (1L << 4)  // User Previous Interrupt Enable
@@ -62,6 +63,8 @@ static inline void w_sip(uint64 x) {
     asm volatile("csrw sip, %0" : : "r"(x));
 }
 
+#define SIP_SSIP (1L << 1) // 软中断等待位 (核间中断, kernelvec.S->mipivec设置)
+
 // S-mode 中断使能
 #define SIE_SEIE (1L << 9)  // 外部设备中断
 #define SIE_STIE (1L << 5)  // 定时器中断
@@ -79,6 +82,7 @@ static inline void w_sie(uint64 x) {
 
 // Machine-mode Interrupt Enable
 #define MIE_STIE (1L << 5)  // supervisor timer
+#define MIE_MSIE (1L << 3)  // machine software (核间中断)
 static inline uint64 r_mie() {
     uint64 x;
     asm volatile("csrr %0, mie" : "=r"(x));
@@ -125,6 +129,17 @@ static inline void w_mideleg(uint64 x) {
     asm volatile("csrw mideleg, %0" : : "r"(x));
 }
 
+// M-mode 异常处理程序地址
+// Machine Trap-Vector Base Address
+static inline void w_mtvec(uint64 x) {
+    asm volatile("csrw mtvec, %0" : : "r"(x));
+}
+
+// M-mode 暂存寄存器
+static inline void w_mscratch(uint64 x) {
+    asm volatile("csrw mscratch, %0" : : "r"(x));
+}
+
 // S-mode 异常处理程序地址
 // Supervisor Trap-Vector Base Address
 // low two bits are mode.
@@ -138,6 +153,12 @@ static inline uint64 r_stvec() {
     return x;
 }
 
+// S-mode 暂存寄存器 (用户态时保存当前线程trapframe的用户虚拟地址)
+// Supervisor Scratch Register
+static inline void w_sscratch(uint64 x) {
+    asm volatile("csrw sscratch, %0" : : "r"(x));
+}
+
 // S-mode 比较计时寄存器 (计时器中断)
 // Supervisor Timer Comparison Register
 static inline uint64 r_stimecmp() {
@@ -176,7 +197,10 @@ static inline void w_pmpaddr0(uint64 x) {
 
 // 使用Sv39分页模式
 #define SATP_SV39 (8L << 60)
+#define SATP_ASID_SHIFT 44
+#define SATP_ASID_MASK (0xFFFFL << SATP_ASID_SHIFT)
 #define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)pagetable) >> 12))
+#define MAKE_SATP_ASID(pagetable, asid) (MAKE_SATP(pagetable) | ((uint64)(asid) << SATP_ASID_SHIFT))
 
 // supervisor address translation and protection;
 // holds the address of the page table.
@@ -263,12 +287,29 @@ static inline uint64 r_ra() {
     return x;
 }
 
+// 帧指针 (s0), 内核使用-fno-omit-frame-pointer编译
+static inline uint64 r_fp() {
+    uint64 x;
+    asm volatile("mv %0, s0" : "=r"(x));
+    return x;
+}
+
 // 清空TLB, 使页表项写入生效
 static inline void sfence_vma() {
     // the zero, zero means flush all TLB entries.
     asm volatile("sfence.vma zero, zero");
 }
 
+// 只刷新指定ASID的TLB项 (不包括全局映射)
+static inline void sfence_vma_asid(uint64 asid) {
+    asm volatile("sfence.vma zero, %0" : : "r"(asid));
+}
+
+// 只刷新指定ASID中虚拟地址va的TLB项
+static inline void sfence_vma_page(uint64 va, uint64 asid) {
+    asm volatile("sfence.vma %0, %1" : : "r"(va), "r"(asid));
+}
+
 typedef uint64 pte_t;
 typedef uint64* pagetable_t;  // 512 PTEs
 
@@ -280,15 +321,25 @@ typedef uint64* pagetable_t;  // 512 PTEs
 #define PGROUNDUP(sz) (((sz) + PGSIZE - 1) & ~(PGSIZE - 1))  // 向上对齐PGSIZE
 #define PGROUNDDOWN(a) (((a)) & ~(PGSIZE - 1))               // 向下对齐PGSIZE
 
+#define MEGAPGSIZE (PGSIZE << 9) // 大页大小 (2MB, 由第1级叶子页表项映射)
+#define MEGAPGORDER 9            // 大页包含 2^9 个页 (kalloc_pages的阶数)
+
+#define MEGAROUNDUP(sz) (((sz) + MEGAPGSIZE - 1) & ~(MEGAPGSIZE - 1)) // 向上对齐MEGAPGSIZE
+#define MEGAROUNDDOWN(a) (((a)) & ~(MEGAPGSIZE - 1))                  // 向下对齐MEGAPGSIZE
+
 // 页表项标志位
 // V=0 : 无效页表项
 // V=1 & R|W|X=0 : 页目录表项
 // V=1 & R|W|X=1 : 页叶子表项
+// V=1 & GUARD=1 : 第0级的保护页 (R|W|X=0, 硬件访问时产生页错误, 软件视为叶子项)
 #define PTE_V (1L << 0)  // 有效位
 #define PTE_R (1L << 1)  // 内核可读位
 #define PTE_W (1L << 2)  // 内核可写位
 #define PTE_X (1L << 3)  // 内核可执行位
 #define PTE_U (1L << 4)  // 用户访问位
+#define PTE_D (1L << 7)  // 脏页位
+#define PTE_COW (1L << 8)  // 写时复制页 (RSW保留位, 硬件忽略)
+#define PTE_GUARD (1L << 9) // 保护页 (RSW保留位, vm.c->uvmclear)
 
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)  // 用物理地址 构造 页表项
 #define PTE2PA(pte) (((pte) >> 10) << 12)        // 提取页表项 中的 物理地址
@@ -0,0 +1,342 @@
+// slab对象缓存
+// 用于管道, 文件描述符, 内存-索引项等定长内核对象
+//
+// 每个缓存由若干slab页组成, 每个slab页首部存放struct slab, 其后紧密排列对象
+// 每个CPU持有一个对象弹匣(magazine), 分配和释放通常只访问本地弹匣
+// 本地弹匣为空时, 从slab页批量补充 MAGSIZE/2 个对象
+// 本地弹匣已满时, 批量归还 MAGSIZE/2 个对象到slab页
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define NCACHE 16  // 缓存的最大数量
+#define MAGSIZE 16 // 每个CPU弹匣的容量
+
+// slab页首部
+struct slab {
+    struct slab* next;
+    struct slab* prev;
+    struct kmem_cache* cache; // 所属缓存
+    void* freelist;           // 页内空闲对象链表
+    int inuse;                // 已分配对象数
+};
+
+// 每个CPU的对象弹匣
+struct magazine {
+    struct spinlock lock; // 只有在回收内存时才会发生竞争
+    int n;                // 弹匣中的对象数
+    void* objs[MAGSIZE];  // 弹匣中的对象
+
+    uint64 nalloc; // 分配次数
+    uint64 nfree;  // 释放次数
+    uint64 hit;    // 直接从弹匣分配的次数
+};
+
+struct kmem_cache {
+    struct spinlock lock; // 保护slab链环
+    char* name;           // 缓存名称
+    uint size;            // 对象大小 (8字节对齐)
+    uint perslab;         // 每个slab页的对象数
+
+    struct slab partial; // 部分使用的slab链环
+    struct slab full;    // 已满的slab链环
+    struct slab empty;   // 空闲的slab链环
+    int nslab;           // slab页总数
+    int nempty;          // 空闲slab页数
+
+    struct magazine mag[NCPU];
+};
+
+// 所有缓存 (只在启动时由CPU0创建, 因此无需加锁)
+struct {
+    struct kmem_cache cache[NCACHE];
+    int n;
+} kcaches;
+
+static void slab_link(struct slab* head, struct slab* s)
+{
+    s->next = head->next;
+    s->prev = head;
+    head->next->prev = s;
+    head->next = s;
+}
+
+static void slab_unlink(struct slab* s)
+{
+    s->prev->next = s->next;
+    s->next->prev = s->prev;
+}
+
+// 创建一个对象大小为size的缓存
+struct kmem_cache* kmem_cache_create(char* name, uint size)
+{
+    size = (size + 7) & ~7;
+    if (size == 0 || size > PGSIZE - sizeof(struct slab))
+        panic("kmem_cache_create: size");
+
+    if (kcaches.n >= NCACHE)
+        panic("kmem_cache_create: too many caches");
+    struct kmem_cache* c = &kcaches.cache[kcaches.n++];
+
+    initlock(&c->lock, name);
+    c->name = name;
+    c->size = size;
+    c->perslab = (PGSIZE - sizeof(struct slab)) / size;
+    c->partial.next = c->partial.prev = &c->partial;
+    c->full.next = c->full.prev = &c->full;
+    c->empty.next = c->empty.prev = &c->empty;
+    for (int i = 0; i < NCPU; i++)
+        initlock(&c->mag[i].lock, "magazine");
+    return c;
+}
+
+// 分配一个slab页并切分为对象 (不能持有c->lock, 因为kalloc可能回收缓存)
+static struct slab* slab_grow(struct kmem_cache* c)
+{
+    struct slab* s = (struct slab*)kalloc();
+    if (s == NULL)
+        return NULL;
+
+    s->cache = c;
+    s->inuse = 0;
+    s->freelist = NULL;
+
+    // 倒序链接, 使得低地址对象先被分配
+    char* base = (char*)s + sizeof(struct slab);
+    for (int i = c->perslab - 1; i >= 0; i--) {
+        void** obj = (void**)(base + i * c->size);
+        *obj = s->freelist;
+        s->freelist = obj;
+    }
+    return s;
+}
+
+// 从slab页取出至多n个对象 (需持有c->lock)
+static int slab_take(struct kmem_cache* c, void** objs, int n)
+{
+    int got = 0;
+
+    while (got < n) {
+        struct slab* s;
+        if (c->partial.next != &c->partial)
+            s = c->partial.next;
+        else if (c->empty.next != &c->empty) {
+            s = c->empty.next;
+            slab_unlink(s);
+            slab_link(&c->partial, s);
+            c->nempty--;
+        } else
+            break;
+
+        while (got < n && s->freelist != NULL) {
+            void** obj = s->freelist;
+            s->freelist = *obj;
+            s->inuse++;
+            objs[got++] = obj;
+        }
+
+        // slab页已满, 移到full链环
+        if (s->freelist == NULL) {
+            slab_unlink(s);
+            slab_link(&c->full, s);
+        }
+    }
+    return got;
+}
+
+// 将对象归还到所属slab页 (需持有c->lock)
+// 空闲slab页多于一个时, 通过*reclaim返回多余的页以便释放
+static void slab_put(struct kmem_cache* c, void* obj, struct slab** reclaim)
+{
+    struct slab* s = (struct slab*)PGROUNDDOWN((uint64)obj);
+    if (s->cache != c || s->inuse <= 0)
+        panic("kmem_cache_free");
+
+    // 原本已满的slab页, 移回partial链环
+    if (s->freelist == NULL) {
+        slab_unlink(s);
+        slab_link(&c->partial, s);
+    }
+
+    *(void**)obj = s->freelist;
+    s->freelist = obj;
+    s->inuse--;
+
+    // slab页变为空闲
+    if (s->inuse == 0) {
+        slab_unlink(s);
+        if (c->nempty >= 1) {
+            // 已有一个空闲页作为缓冲, 释放这一页
+            c->nslab--;
+            s->next = *reclaim;
+            *reclaim = s;
+        } else {
+            slab_link(&c->empty, s);
+            c->nempty++;
+        }
+    }
+}
+
+// 将一批对象归还到slab页, 并释放多余的空闲页
+static void slab_putn(struct kmem_cache* c, void** objs, int n)
+{
+    struct slab* reclaim = NULL;
+
+    acquire(&c->lock);
+    for (int i = 0; i < n; i++)
+        slab_put(c, objs[i], &reclaim);
+    release(&c->lock);
+
+    while (reclaim != NULL) {
+        struct slab* next = reclaim->next;
+        kfree(reclaim);
+        reclaim = next;
+    }
+}
+
+// 从缓存分配一个对象, 内存耗尽时返回NULL
+void* kmem_cache_alloc(struct kmem_cache* c)
+{
+    void* obj = NULL;
+
+    push_off(); //* 禁用中断, 确保不会切换CPU
+    struct magazine* m = &c->mag[cpuid()];
+
+    acquire(&m->lock);
+    if (m->n > 0) {
+        obj = m->objs[--m->n];
+        m->nalloc++;
+        m->hit++;
+    }
+    release(&m->lock);
+
+    // 本地弹匣为空, 从slab页批量补充
+    if (obj == NULL) {
+        void* objs[MAGSIZE / 2];
+        int n;
+
+        acquire(&c->lock);
+        n = slab_take(c, objs, MAGSIZE / 2);
+        release(&c->lock);
+
+        // 没有空闲对象, 分配新的slab页
+        if (n == 0) {
+            struct slab* s = slab_grow(c);
+            if (s != NULL) {
+                acquire(&c->lock);
+                slab_link(&c->empty, s);
+                c->nslab++;
+                c->nempty++;
+                n = slab_take(c, objs, MAGSIZE / 2);
+                release(&c->lock);
+            }
+        }
+
+        if (n > 0) {
+            obj = objs[--n];
+            acquire(&m->lock);
+            m->nalloc++;
+            while (n > 0 && m->n < MAGSIZE)
+                m->objs[m->n++] = objs[--n];
+            release(&m->lock);
+
+            // 弹匣在此期间已被填满, 归还剩余对象
+            if (n > 0)
+                slab_putn(c, objs, n);
+        }
+    }
+    pop_off(); //* 恢复之前的中断状态
+
+    return obj;
+}
+
+// 将对象释放回缓存
+void kmem_cache_free(struct kmem_cache* c, void* obj)
+{
+    void* objs[MAGSIZE / 2];
+    int n = 0;
+
+    push_off(); //* 禁用中断, 确保不会切换CPU
+    struct magazine* m = &c->mag[cpuid()];
+
+    acquire(&m->lock);
+    m->nfree++;
+
+    // 本地弹匣已满, 取出一半归还到slab页
+    if (m->n == MAGSIZE) {
+        while (n < MAGSIZE / 2)
+            objs[n++] = m->objs[--m->n];
+    }
+    m->objs[m->n++] = obj;
+    release(&m->lock);
+
+    if (n > 0)
+        slab_putn(c, objs, n);
+    pop_off(); //* 恢复之前的中断状态
+}
+
+// 清空所有弹匣并释放所有空闲slab页
+// 物理内存耗尽时由kalloc调用, 返回释放的页数
+int kmem_cache_reap(void)
+{
+    int freed = 0;
+
+    for (int i = 0; i < kcaches.n; i++) {
+        struct kmem_cache* c = &kcaches.cache[i];
+
+        for (int cpu = 0; cpu < NCPU; cpu++) {
+            struct magazine* m = &c->mag[cpu];
+            void* objs[MAGSIZE];
+            int n = 0;
+
+            acquire(&m->lock);
+            while (m->n > 0)
+                objs[n++] = m->objs[--m->n];
+            release(&m->lock);
+
+            if (n > 0)
+                slab_putn(c, objs, n);
+        }
+
+        struct slab* reclaim = NULL;
+        acquire(&c->lock);
+        while (c->empty.next != &c->empty) {
+            struct slab* s = c->empty.next;
+            slab_unlink(s);
+            c->nempty--;
+            c->nslab--;
+            s->next = reclaim;
+            reclaim = s;
+        }
+        release(&c->lock);
+
+        while (reclaim != NULL) {
+            struct slab* next = reclaim->next;
+            kfree(reclaim);
+            reclaim = next;
+            freed++;
+        }
+    }
+    return freed;
+}
+
+// 打印每个缓存的使用统计 (procdump调用, 不使用锁)
+void slabdump(void)
+{
+    printf("slab: name objsize active/total slabs alloc hit\n");
+    for (int i = 0; i < kcaches.n; i++) {
+        struct kmem_cache* c = &kcaches.cache[i];
+        uint64 nalloc = 0, nfree = 0, hit = 0;
+        for (int cpu = 0; cpu < NCPU; cpu++) {
+            nalloc += c->mag[cpu].nalloc;
+            nfree += c->mag[cpu].nfree;
+            hit += c->mag[cpu].hit;
+        }
+        printf("  %s: %d %lu/%d %d %lu %lu\n", c->name, c->size, nalloc - nfree, c->nslab * c->perslab, c->nslab,
+            nalloc, hit);
+    }
+}
@@ -14,19 +14,40 @@ void initsleeplock(struct sleeplock* lk, char* name)
     initlock(&lk->lk, "sleep lock");
     lk->name = name;
     lk->locked = 0;
-    lk->pid = 0;
+    lk->owner = 0;
 }
 
-// 获取锁 如果锁被占用则休眠
+// 持有者是否正在其他CPU上运行 (不加锁读取, 只作为自旋的提示)
+static int ownerrunning(struct sleeplock* lk, struct proc* owner)
+{
+    return __atomic_load_n(&lk->locked, __ATOMIC_RELAXED) && __atomic_load_n(&lk->owner, __ATOMIC_RELAXED) == owner &&
+           __atomic_load_n(&owner->state, __ATOMIC_RELAXED) == RUNNING;
+}
+
+// 获取锁 如果锁被占用则等待
+// 持有者正在其他CPU上运行时, 通常很快就会释放锁 (例如bread/brelse之间), 自旋等待
+// 持有者休眠或被抢占时, 自旋没有意义, 改为休眠等待唤醒
 void acquiresleep(struct sleeplock* lk)
 {
+    struct proc* p = myproc();
+
     acquire(&lk->lk); //*
 
-    while (lk->locked)
+    while (lk->locked) {
+        struct proc* owner = lk->owner;
+        if (owner != p && owner->state == RUNNING) {
+            // 释放自旋锁后自旋, 期间中断开启, 仍可以被抢占和响应核间中断
+            release(&lk->lk); //*
+            while (ownerrunning(lk, owner))
+                ;
+            acquire(&lk->lk); //*
+            continue;
+        }
         sleep(lk, &lk->lk); //*
+    }
 
     lk->locked = 1;
-    lk->pid = myproc()->pid;
+    lk->owner = p;
 
     release(&lk->lk); //*
 }
@@ -37,9 +58,9 @@ void releasesleep(struct sleeplock* lk)
     acquire(&lk->lk); //*
 
     lk->locked = 0;
-    lk->pid = 0;
+    lk->owner = 0;
 
-    wakeup(lk); // 唤醒等待锁的进程
+    wakeone(lk); // 只唤醒一个等待锁的进程, 其余进程继续休眠
 
     release(&lk->lk); //*
 }
@@ -48,7 +69,7 @@ void releasesleep(struct sleeplock* lk)
 int holdingsleep(struct sleeplock* lk)
 {
     acquire(&lk->lk); //*
-    int r = lk->locked && (lk->pid == myproc()->pid);
+    int r = lk->locked && (lk->owner == myproc());
     release(&lk->lk); //*
     return r;
 }
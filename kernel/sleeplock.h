@@ -1,8 +1,7 @@
-
 // 睡眠锁
 typedef struct sleeplock {
-    char* name;  // 锁名称
-    uint locked; // 是否持有
-    int pid;     // 持有锁的进程
-    spinlock lk; // 用自旋锁保护变量
+    char* name;         // 锁名称
+    uint locked;        // 是否持有
+    struct proc* owner; // 持有锁的进程 (进程结构体类型稳定, 可以不加锁读取其状态)
+    spinlock lk;        // 用自旋锁保护变量
 } sleeplock;
@@ -7,12 +7,52 @@
 #include "proc.h"
 #include "defs.h"
 
+// 自旋锁竞争统计, 按锁名称分类 (例如所有进程的p->lock都属于"proc")
+// 计数器按CPU分开, 获取锁后只修改本CPU的计数器, 不需要原子操作, 也不会在CPU之间传递缓存行
+// 类别0收纳无名称或类别表已满的锁
+#define NLOCKCLASS 64 // 锁类别的最大数量
+#define NLOCKTOP 8    // lockdump打印的类别数
+
+struct lockstat {
+    uint64 nacquire; // 获取次数
+    uint64 ncontend; // 需要等待的次数
+    uint64 spin;     // 等待的time寄存器周期数
+};
+
+static char* lockclasses[NLOCKCLASS];               // 类别的锁名称, 只增不减
+static struct lockstat lockstats[NCPU][NLOCKCLASS]; // 每个CPU每个类别的计数器
+
+// 查找或登记名称为name的锁类别 (开放寻址, 不加锁, 通过CAS登记)
+static int lockclass(char* name)
+{
+    if (name == 0)
+        return 0;
+
+    uint h = 0;
+    for (char* s = name; *s; s++)
+        h = h * 31 + *s;
+
+    for (int i = 0; i < NLOCKCLASS; i++) {
+        int c = (h + i) % NLOCKCLASS;
+        if (c == 0)
+            continue;
+        if (lockclasses[c] == 0 && __sync_bool_compare_and_swap(&lockclasses[c], 0, name))
+            return c;
+        char* s = __atomic_load_n(&lockclasses[c], __ATOMIC_ACQUIRE);
+        if (s == name || strncmp(s, name, 32) == 0)
+            return c;
+    }
+    return 0;
+}
+
 // 初始化自旋锁
 void initlock(struct spinlock* lk, char* name)
 {
     lk->name = name; // 锁名称
-    lk->locked = 0;
+    lk->next = 0;
+    lk->owner = 0;
     lk->cpu = 0;
+    lk->cls = lockclass(name);
 }
 
 // 不断循环直到获取自旋锁
@@ -24,12 +64,17 @@ void acquire(struct spinlock* lk)
     if (holding(lk))
         panic("acquire");
 
-    // a5 = 1
-    // s1 = &lk->locked
-    // amoswap.w.aq a5, a5, (s1)   <原子交换操作>
-    // aq: 该指令后序所有访存 必须等该指令完成后才开始执行
-    while (__sync_lock_test_and_set(&lk->locked, 1) != 0)
-        ;
+    // 取号: amoadd.w ticket, 1, (&lk->next)  <原子加法操作>
+    // 然后等待owner轮到自己, 等待者按取号顺序获取锁
+    // 自旋期间中断已关闭, 锁的持有者可能正在等待本CPU刷新TLB (vm.c->uvmflush)
+    uint ticket = __atomic_fetch_add(&lk->next, 1, __ATOMIC_RELAXED);
+    uint64 spin = 0;
+    if (__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != ticket) {
+        uint64 start = r_time();
+        while (__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != ticket)
+            tlbsync();
+        spin = r_time() - start + 1;
+    }
 
     // 告诉gcc和CPU不要将 前后的内存操作越过此处
     // 以确保关键区的内存使用 严格在锁被获取之后发生
@@ -37,6 +82,14 @@ void acquire(struct spinlock* lk)
 
     // 记录当前CPU信息到锁中 (用于调试)
     lk->cpu = mycpu();
+
+    // 更新本CPU的竞争统计
+    struct lockstat* st = &lockstats[cpuid()][lk->cls];
+    st->nacquire++;
+    if (spin) {
+        st->ncontend++;
+        st->spin += spin;
+    }
 }
 
 // 释放自旋锁
@@ -53,9 +106,8 @@ void release(struct spinlock* lk)
     // 以确保关键区的内存使用 严格在释放锁之前发生
     __sync_synchronize(); // 内存屏障
 
-    // s1 = &lk->locked
-    // amoswap.w zero, zero, (s1)  <原子交换操作>
-    __sync_lock_release(&lk->locked);
+    // 叫下一个号, 只有持有者修改owner, 因此不需要原子读改写
+    __atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELEASE);
 
     pop_off(); //* 恢复之前的中断状态
 }
@@ -63,7 +115,8 @@ void release(struct spinlock* lk)
 // 检查当前CPU是否持有锁
 inline int holding(struct spinlock* lk)
 {
-    int r = (lk->locked && lk->cpu == mycpu());
+    int r = (__atomic_load_n(&lk->owner, __ATOMIC_RELAXED) != __atomic_load_n(&lk->next, __ATOMIC_RELAXED) &&
+        lk->cpu == mycpu());
     return r;
 }
 
@@ -102,3 +155,34 @@ void pop_off(void)
     if (c->off_num == 0 && c->intr_enable)
         intr_on();
 }
+
+// 打印等待时间最长的NLOCKTOP个锁类别 (procdump调用, 不使用锁)
+// 时间以微秒为单位
+void lockdump(void)
+{
+    static struct lockstat sum[NLOCKCLASS];
+    static char shown[NLOCKCLASS];
+
+    for (int c = 0; c < NLOCKCLASS; c++) {
+        sum[c].nacquire = sum[c].ncontend = sum[c].spin = 0;
+        shown[c] = 0;
+        for (int i = 0; i < NCPU; i++) {
+            sum[c].nacquire += lockstats[i][c].nacquire;
+            sum[c].ncontend += lockstats[i][c].ncontend;
+            sum[c].spin += lockstats[i][c].spin;
+        }
+    }
+
+    printf("lock: name acquire contend spin(us)\n");
+    for (int n = 0; n < NLOCKTOP; n++) {
+        int top = -1;
+        for (int c = 0; c < NLOCKCLASS; c++)
+            if (!shown[c] && sum[c].ncontend > 0 && (top < 0 || sum[c].spin > sum[top].spin))
+                top = c;
+        if (top < 0)
+            break;
+        shown[top] = 1;
+        printf("  %s: %lu %lu %lu\n", lockclasses[top] ? lockclasses[top] : "?", sum[top].nacquire,
+            sum[top].ncontend, sum[top].spin / (TIMEBASE / 1000000));
+    }
+}
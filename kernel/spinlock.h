@@ -1,7 +1,10 @@
-
-// 自旋锁
+// 自旋锁 (排号锁)
+// 每个CPU取一个号码(next), 等到正在服务的号码(owner)轮到自己
+// 按到达顺序获取, 等待者只读owner, 释放时只有持有者写owner
 typedef struct spinlock {
+    uint next;       // 下一个取号的号码
+    uint owner;      // 正在服务的号码, 与next相等时未被持有
     char* name;      // 锁名称
-    uint locked;     // 是否持有
     struct cpu* cpu; // 持有锁的CPU
+    int cls;         // 竞争统计的类别 (spinlock.c->lockclass), 同名的锁共用一个类别
 } spinlock;
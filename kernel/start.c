@@ -6,10 +6,17 @@
 
 void main();
 void timerinit();
+void ipiinit();
 
 // entry.S 需要给每个CPU一个栈
 __attribute__((aligned(16))) char stack0[4096 * NCPU];
 
+// kernelvec.S->mipivec 的每个CPU暂存区
+uint64 mscratch0[NCPU][2];
+
+// in kernelvec.S, M-mode软件中断 (核间中断)
+void mipivec();
+
 // entry.S 跳转到此处 (M-mode)
 void start()
 {
@@ -37,6 +44,9 @@ void start()
     // 启用定时器中断
     timerinit();
 
+    // 启用核间中断
+    ipiinit();
+
     // 将每个CPU的hartid保存到tp寄存器中, 用于cpuid()
     int id = r_mhartid();
     w_tp(id);
@@ -58,5 +68,18 @@ void timerinit()
     w_mcounteren(r_mcounteren() | 2);
 
     // 设定第一次定时器中断 (大约0.1秒)
-    w_stimecmp(r_time() + 1000000);
+    // 之后由trap.c->timerset按需设定
+    w_stimecmp(r_time() + TIMER_INTERVAL);
+}
+
+// 请求每个CPU启用核间中断
+// 其他CPU写CLINT msip触发M-mode软件中断, 由mipivec转为S-mode软件中断
+void ipiinit()
+{
+    int id = r_mhartid();
+    w_mscratch((uint64)mscratch0[id]);
+    w_mtvec((uint64)mipivec);
+
+    // 启用M-mode软件中断 (S-mode及以下运行时总是全局启用)
+    w_mie(r_mie() | MIE_MSIE);
 }
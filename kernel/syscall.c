@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "syscall.h"
+#include "trace.h"
 #include "defs.h"
 
 // 获取当前进程地址中 addr处 的uint64
@@ -12,8 +13,8 @@ int fetchaddr(uint64 addr, uint64* ip)
 {
     struct proc* p = myproc();
 
-    if (addr >= p->sz
-        || addr + sizeof(uint64) > p->sz) // both tests needed, in case of overflow
+    if (addr >= p->mm->sz
+        || addr + sizeof(uint64) > p->mm->sz) // both tests needed, in case of overflow
         return -1;
 
     // 从用户空间 复制数据到 内核空间
@@ -28,6 +29,7 @@ int fetchaddr(uint64 addr, uint64* ip)
 int fetchstr(uint64 addr, char* buf, int max)
 {
     struct proc* p = myproc();
+    mmapprefault(addr, max, false); // 字符串可能位于尚未读入的文件映射页
     if (copyinstr(p->pagetable, buf, addr, max) < 0)
         return -1;
     return strlen(buf);
@@ -92,6 +94,18 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_getpriority(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_clock_gettime(void);
+extern uint64 sys_futex_wait(void);
+extern uint64 sys_futex_wake(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_join(void);
+extern uint64 sys_waitpid(void);
+extern uint64 sys_getrusage(void);
 
 // 系统调用函数映射表
 static uint64 (*syscalls[])(void) = {
@@ -116,6 +130,18 @@ static uint64 (*syscalls[])(void) = {
     [SYS_link] sys_link,
     [SYS_mkdir] sys_mkdir,
     [SYS_close] sys_close,
+    [SYS_mmap] sys_mmap,
+    [SYS_munmap] sys_munmap,
+    [SYS_setpriority] sys_setpriority,
+    [SYS_getpriority] sys_getpriority,
+    [SYS_nanosleep] sys_nanosleep,
+    [SYS_clock_gettime] sys_clock_gettime,
+    [SYS_futex_wait] sys_futex_wait,
+    [SYS_futex_wake] sys_futex_wake,
+    [SYS_clone] sys_clone,
+    [SYS_join] sys_join,
+    [SYS_waitpid] sys_waitpid,
+    [SYS_getrusage] sys_getrusage,
 };
 
 // 处理系统调用
@@ -130,7 +156,9 @@ void syscall(void)
     if (num > 0 && num < NELEM(syscalls) && syscalls[num]) {
         // 如果num在合法范围内, 并且对应的系统调用函数存在
         // 通过编号来访问系统调用, 并将返回值存储在a0中
+        TRACEPOINT(TR_SYSCALL_ENTER, num, 0);
         p->trapframe->a0 = syscalls[num]();
+        TRACEPOINT(TR_SYSCALL_EXIT, num, p->trapframe->a0);
     } else {
         printf("%d %s: unknown sys call %d\n", p->pid, p->name, num);
         p->trapframe->a0 = -1;
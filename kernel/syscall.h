@@ -22,3 +22,15 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_mmap   22
+#define SYS_munmap 23
+#define SYS_setpriority 24
+#define SYS_getpriority 25
+#define SYS_nanosleep 26
+#define SYS_clock_gettime 27
+#define SYS_futex_wait 28
+#define SYS_futex_wake 29
+#define SYS_clone 30
+#define SYS_join 31
+#define SYS_waitpid 32
+#define SYS_getrusage 33
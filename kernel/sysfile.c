@@ -4,7 +4,7 @@
 //  -------------------------------------------------
 //  + FS.img: 文件系统映像 (mkfs.c)
 //  + VirtIO: 虚拟硬盘驱动 (virtio.h virtio_disk.c)
-//  + BCache: LRU缓存链环 (buf.h bio.c)
+//  + BCache: LRU缓存哈希表 (buf.h bio.c)
 //  + Log: 两步提交的日志系统 (log.c)
 //  + Inode Dir Path: 硬盘文件系统实现 (stat.h fs.h fs.c)
 //  + Pipe: 管道实现 (pipe.c)
@@ -28,57 +28,78 @@
 #include "fcntl.h"
 
 // 获取第n个系统调用参数 (文件描述符)
-// 返回文件描述符和对应的文件结构体
+// 返回文件描述符和对应的文件结构体, 并增加文件的引用计数
+// 同一进程的其他线程可能同时关闭该文件描述符, 调用者使用完文件后需要fileclose
 // n:参数索引  pdf:返回文件描述符值  pf:返回文件结构体
 static int argfd(int n, int* pfd, struct file** pf)
 {
     int fd;
     argint(n, &fd);
+    if (fd < 0 || fd >= NOFILE)
+        return -1;
 
-    struct file* f;
-    if (fd < 0 || fd >= NOFILE || (f = myproc()->ofile[fd]) == 0)
+    struct fdtable* fdt = myproc()->fdt;
+    acquire(&fdt->lock);
+    struct file* f = fdt->ofile[fd];
+    if (f == 0) {
+        release(&fdt->lock);
         return -1;
+    }
+    filedup(f);
+    release(&fdt->lock);
 
     if (pfd)
         *pfd = fd;
 
-    if (pf)
-        *pf = f;
-
+    *pf = f;
     return 0;
 }
 
-// 对于给定的文件 分配一个文件描述符
+// 对于给定的文件 分配一个文件描述符 (文件描述符表接管调用者的引用)
 static int fdalloc(struct file* f)
 {
-    struct proc* p = myproc();
+    struct fdtable* fdt = myproc()->fdt;
 
     // 遍历进程的文件描述符表, 分配空闲文件描述符
+    acquire(&fdt->lock);
     for (int fd = 0; fd < NOFILE; fd++) {
-        if (p->ofile[fd] == 0) {
-            p->ofile[fd] = f;
+        if (fdt->ofile[fd] == 0) {
+            fdt->ofile[fd] = f;
+            release(&fdt->lock);
             return fd;
         }
     }
+    release(&fdt->lock);
     return -1;
 }
 
+// 清除文件描述符fd, 返回它指向的文件 (引用交给调用者), fd未打开时返回0
+static struct file* fdclear(int fd)
+{
+    struct fdtable* fdt = myproc()->fdt;
+
+    acquire(&fdt->lock);
+    struct file* f = fdt->ofile[fd];
+    fdt->ofile[fd] = 0;
+    release(&fdt->lock);
+    return f;
+}
+
 // int dup(int fd)
 uint64 sys_dup(void)
 {
     int fd;
 
-    // 获取对应文件结构体
+    // 获取对应文件结构体 (增加引用计数)
     struct file* f;
     if (argfd(0, 0, &f) < 0)
         return -1;
 
     // 分配 指向相同文件结构体的 新文件描述符
-    if ((fd = fdalloc(f)) < 0)
+    if ((fd = fdalloc(f)) < 0) {
+        fileclose(f);
         return -1;
-
-    // 增加引用计数
-    filedup(f);
+    }
 
     return fd;
 }
@@ -98,7 +119,9 @@ uint64 sys_read(void)
     int n;
     argint(2, &n);
 
-    return fileread(f, buf, n);
+    int r = fileread(f, buf, n);
+    fileclose(f);
+    return r;
 }
 
 // int write(int fd, char *buf, int n)
@@ -113,18 +136,20 @@ uint64 sys_write(void)
     argaddr(1, &buf);
     argint(2, &n);
 
-    return filewrite(f, buf, n);
+    int r = filewrite(f, buf, n);
+    fileclose(f);
+    return r;
 }
 
 // int close(int fd)
 uint64 sys_close(void)
 {
     int fd;
-    struct file* f;
+    argint(0, &fd);
 
-    if (argfd(0, &fd, &f) < 0)
+    struct file* f;
+    if (fd < 0 || fd >= NOFILE || (f = fdclear(fd)) == 0)
         return -1;
-    myproc()->ofile[fd] = 0;
     fileclose(f);
     return 0;
 }
@@ -138,7 +163,9 @@ uint64 sys_fstat(void)
     argaddr(1, &st);
     if (argfd(0, 0, &f) < 0)
         return -1;
-    return filestat(f, st);
+    int r = filestat(f, st);
+    fileclose(f);
+    return r;
 }
 
 // int link(char *old, char *new)
@@ -461,7 +488,7 @@ uint64 sys_chdir(void)
 {
     char path[MAXPATH];
     struct minode* ip;
-    struct proc* p = myproc();
+    struct fdtable* fdt = myproc()->fdt;
 
     begin_op(); //* 事务开始
     if (argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0) {
@@ -475,9 +502,15 @@ uint64 sys_chdir(void)
         return -1;
     }
     iunlock(ip);
-    iput(p->cwd);
+
+    // 同一进程的其他线程共享工作目录
+    acquire(&fdt->lock);
+    struct minode* old = fdt->cwd;
+    fdt->cwd = ip;
+    release(&fdt->lock);
+
+    iput(old);
     end_op(); //* 事务结束
-    p->cwd = ip;
     return 0;
 }
 
@@ -553,18 +586,52 @@ uint64 sys_pipe(void)
     fd0 = -1;
     if ((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0) {
         if (fd0 >= 0)
-            p->ofile[fd0] = 0;
+            fdclear(fd0);
         fileclose(rf);
         fileclose(wf);
         return -1;
     }
     if (copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0
         || copyout(p->pagetable, fdarray + sizeof(fd0), (char*)&fd1, sizeof(fd1)) < 0) {
-        p->ofile[fd0] = 0;
-        p->ofile[fd1] = 0;
+        fdclear(fd0);
+        fdclear(fd1);
         fileclose(rf);
         fileclose(wf);
         return -1;
     }
     return 0;
 }
+
+// void* mmap(void* addr, uint64 len, int prot, int flags, int fd, uint64 off)
+uint64 sys_mmap(void)
+{
+    uint64 addr, len, off;
+    int prot, flags;
+    struct file* f = NULL;
+
+    argaddr(0, &addr);
+    argaddr(1, &len);
+    argint(2, &prot);
+    argint(3, &flags);
+    argaddr(5, &off);
+
+    // 匿名映射忽略fd
+    if ((flags & MAP_ANONYMOUS) == 0 && argfd(4, 0, &f) < 0)
+        return -1;
+
+    // 映射持有自己的文件引用
+    uint64 r = mmap(addr, len, prot, flags, f, off);
+    if (f)
+        fileclose(f);
+    return r;
+}
+
+// int munmap(void* addr, uint64 len)
+uint64 sys_munmap(void)
+{
+    uint64 addr, len;
+
+    argaddr(0, &addr);
+    argaddr(1, &len);
+    return munmap(addr, len);
+}
@@ -5,6 +5,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "time.h"
 
 // int exit(int status)
 uint64 sys_exit(void)
@@ -32,16 +33,26 @@ uint64 sys_wait(void)
     return wait(status);
 }
 
+// int waitpid(int pid, int* status, int options)
+uint64 sys_waitpid(void)
+{
+    int pid, options;
+    uint64 status;
+    argint(0, &pid);
+    argaddr(1, &status);
+    argint(2, &options);
+
+    return waitpid(pid, status, options);
+}
+
 // char *sbrk(int n)
 uint64 sys_sbrk(void)
 {
     int n;
     argint(0, &n);
 
-    uint64 addr = myproc()->sz;
-    if (growproc(n) < 0)
-        return -1;
-    return addr;
+    // 返回原来的内存大小, 即新增内存的起始地址
+    return growproc(n);
 }
 
 // int sleep(int n)
@@ -52,24 +63,104 @@ uint64 sys_sleep(void)
     if (n < 0)
         n = 0;
 
-    acquire(&tickslock); // 获取锁
-
-    // 记录当前时钟中断计数
+    // 记录当前时钟周期数 (tickless时ticks需要先根据time寄存器推进)
+    acquire(&tickslock);
+    ticksync();
     uint ticks0 = ticks;
+    release(&tickslock);
+
+    // 在第ticks0+n个时钟周期开始时唤醒, 如果进程被终止, 则返回-1
+    if (timersleep(boottime + (uint64)(ticks0 + n) * TIMER_INTERVAL) < 0)
+        return -1;
+
+    return 0;
+}
+
+// 将时长转换为time寄存器周期数 (向上取整, 保证不会提前唤醒)
+static uint64 ts2cycles(struct timespec* ts)
+{
+    return ts->tv_sec * TIMEBASE + (ts->tv_nsec * (TIMEBASE / 1000000) + 999) / 1000;
+}
+
+static void cycles2ts(uint64 cycles, struct timespec* ts)
+{
+    ts->tv_sec = cycles / TIMEBASE;
+    ts->tv_nsec = (cycles % TIMEBASE) * (NSEC_PER_SEC / TIMEBASE);
+}
+
+// int nanosleep(const struct timespec* req, struct timespec* rem)
+// 休眠req指定的时长, 被终止时返回-1, 并通过rem(可以为0)返回剩余时长
+uint64 sys_nanosleep(void)
+{
+    uint64 ureq, urem;
+    argaddr(0, &ureq);
+    argaddr(1, &urem);
+
+    struct proc* p = myproc();
+    struct timespec ts;
+    if (copyin(p->pagetable, (char*)&ts, ureq, sizeof(ts)) < 0)
+        return -1;
+    if (ts.tv_nsec >= NSEC_PER_SEC || ts.tv_sec >= (1UL << 32))
+        return -1;
 
-    // 等待n个时钟中断
-    while (ticks - ticks0 < n) {
-        // 如果进程被终止, 则返回-1
-        if (killed(myproc())) {
-            release(&tickslock);
-            return -1;
-        }
-        // 释放锁 并在ticks上休眠
-        sleep(&ticks, &tickslock);
+    uint64 expires = r_time() + ts2cycles(&ts);
+    if (timersleep(expires) == 0)
+        return 0;
+
+    if (urem != 0) {
+        uint64 now = r_time();
+        cycles2ts(expires > now ? expires - now : 0, &ts);
+        copyout(p->pagetable, urem, (char*)&ts, sizeof(ts));
     }
+    return -1;
+}
+
+// int clock_gettime(int clockid, struct timespec* tp)
+// 只支持CLOCK_MONOTONIC: 启动以来经过的时间, 精度为time寄存器的一个周期 (100ns)
+uint64 sys_clock_gettime(void)
+{
+    int clockid;
+    uint64 utp;
+    argint(0, &clockid);
+    argaddr(1, &utp);
+
+    if (clockid != CLOCK_MONOTONIC)
+        return -1;
+
+    struct timespec ts;
+    cycles2ts(r_time() - boottime, &ts);
+    if (copyout(myproc()->pagetable, utp, (char*)&ts, sizeof(ts)) < 0)
+        return -1;
+    return 0;
+}
 
-    release(&tickslock); // 释放锁
+// int getrusage(int who, struct rusage* ru)
+// 统计只由进程自己和回收它的父进程修改, 因此读取时不需要加锁
+uint64 sys_getrusage(void)
+{
+    int who;
+    uint64 uru;
+    argint(0, &who);
+    argaddr(1, &uru);
+
+    struct proc* p = myproc();
+    struct pacct* a;
+    if (who == RUSAGE_SELF)
+        a = &p->acct;
+    else if (who == RUSAGE_CHILDREN)
+        a = &p->cacct;
+    else
+        return -1;
 
+    struct rusage ru;
+    cycles2ts(a->utime, &ru.ru_utime);
+    cycles2ts(a->stime, &ru.ru_stime);
+    ru.ru_nvcsw = a->nvcsw;
+    ru.ru_nivcsw = a->nivcsw;
+    ru.ru_nsyscall = a->nsyscall;
+    ru.ru_nfault = a->nfault;
+    if (copyout(p->pagetable, uru, (char*)&ru, sizeof(ru)) < 0)
+        return -1;
     return 0;
 }
 
@@ -82,15 +173,83 @@ uint64 sys_kill(void)
     return kill(pid);
 }
 
+// int setpriority(int pid, int nice)
+// pid为0表示当前进程
+uint64 sys_setpriority(void)
+{
+    int pid, nice;
+    argint(0, &pid);
+    argint(1, &nice);
+
+    return setnice(pid, nice);
+}
+
+// int getpriority(int pid)
+// 与Linux的系统调用相同, 返回 20-nice (1~40), 使得合法值不会与-1混淆
+uint64 sys_getpriority(void)
+{
+    int pid, nice;
+    argint(0, &pid);
+
+    if (getnice(pid, &nice) < 0)
+        return -1;
+    return 20 - nice;
+}
+
 // int uptime()
-// 返回已发生的时钟中断次数
+// 返回启动以来经过的时钟周期数
 uint64 sys_uptime(void)
 {
     uint xticks;
 
     acquire(&tickslock);
+    ticksync();
     xticks = ticks;
     release(&tickslock);
     
     return xticks;
 }
+
+// int futex_wait(int* addr, int val)
+uint64 sys_futex_wait(void)
+{
+    uint64 addr;
+    int val;
+    argaddr(0, &addr);
+    argint(1, &val);
+
+    return futexwait(addr, val);
+}
+
+// int futex_wake(int* addr, int n)
+uint64 sys_futex_wake(void)
+{
+    uint64 addr;
+    int n;
+    argaddr(0, &addr);
+    argint(1, &n);
+
+    return futexwake(addr, n);
+}
+
+// int clone(void (*fn)(void*), void* arg, void* stack)
+uint64 sys_clone(void)
+{
+    uint64 fn, arg, stack;
+    argaddr(0, &fn);
+    argaddr(1, &arg);
+    argaddr(2, &stack);
+
+    return clone(fn, arg, stack);
+}
+
+// int join(int tid, int* status)
+uint64 sys_join(void)
+{
+    int tid;
+    uint64 status;
+    argint(0, &tid);
+    argaddr(1, &status);
+
+    return join(tid, status);
+}
@@ -0,0 +1,22 @@
+// 时钟编号 (clock_gettime)
+#define CLOCK_MONOTONIC 1 // 启动以来单调递增的时间
+
+#define NSEC_PER_SEC 1000000000UL
+
+struct timespec {
+    uint64 tv_sec;  // 秒
+    uint64 tv_nsec; // 纳秒 (0 ~ NSEC_PER_SEC-1)
+};
+
+// int getrusage(int who, struct rusage* ru)
+#define RUSAGE_SELF 0      // 当前线程, 包括已经join回收的线程
+#define RUSAGE_CHILDREN -1 // 已经wait回收的子进程, 包括它们回收的后代
+
+struct rusage {
+    struct timespec ru_utime; // 用户态时间
+    struct timespec ru_stime; // 内核态时间
+    uint64 ru_nvcsw;          // 主动让出CPU的次数 (休眠)
+    uint64 ru_nivcsw;         // 被动让出CPU的次数 (时间片用完)
+    uint64 ru_nsyscall;       // 系统调用次数
+    uint64 ru_nfault;         // 页错误次数
+};
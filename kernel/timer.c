@@ -0,0 +1,257 @@
+// 高精度定时器 (分层时间轮)
+//
+// 每个CPU持有一个定时器基(tbase), 定时器加入当前CPU的时间轮, 由该CPU的定时器中断触发
+// 时间单位为time寄存器的周期 (param.h->TIMEBASE)
+//
+// 时间轮共WHEEL_LEVELS层, 每层WHEEL_SLOTS个槽
+// 第0层每个槽跨度为 2^WHEEL_SHIFT 个周期 (约0.1ms), 每升高一层槽跨度乘以WHEEL_SLOTS
+// 远期的定时器放在高层, 时钟推进到所在槽的起点时再下放(cascade)到低层
+// 第0层按精确的到期时间触发, 并据此设定stimecmp, 因此精度只受中断延迟限制
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define WHEEL_SHIFT 10                  // 第0层槽跨度 (2^10个周期, 约0.1ms)
+#define WHEEL_BITS 6                    // 每层槽数的位数
+#define WHEEL_SLOTS (1 << WHEEL_BITS)   // 每层槽数
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4                  // 层数 (可表示约1700秒, 更远的定时器到时会重新下放)
+#define WHEEL_MAX ((1UL << (WHEEL_BITS * WHEEL_LEVELS)) - 1) // 时间轮能表示的最大间隔 (第0层槽数)
+
+// 第level层槽的跨度 (第0层槽数)
+#define LEVEL_SPAN(level) (1UL << (WHEEL_BITS * (level)))
+
+struct timer {
+    struct timer* next;
+    struct timer** pprev;      // 指向前一个定时器的next (或槽头)
+    uint64 expires;            // 到期时间 (time寄存器)
+    void (*fn)(struct timer*); // 到期时在中断上下文中调用, 此时持有时间轮锁, 不能休眠
+    struct tbase* base;        // 所在时间轮, 不在时间轮中时为0
+};
+
+// 每个CPU的时间轮
+struct tbase {
+    struct spinlock lock;
+    uint64 clk;                                    // 下一个待处理的第0层槽序号 (time >> WHEEL_SHIFT)
+    int n;                                         // 时间轮中的定时器数
+    struct timer* wheel[WHEEL_LEVELS][WHEEL_SLOTS]; // 每个槽是定时器链表
+
+    uint64 nfired;   // 触发的定时器数
+    uint64 ncascade; // 下放的定时器数
+} tbases[NCPU];
+
+void wheelinit(void)
+{
+    uint64 clk = r_time() >> WHEEL_SHIFT;
+    for (int i = 0; i < NCPU; i++) {
+        initlock(&tbases[i].lock, "tbase");
+        tbases[i].clk = clk;
+    }
+}
+
+// 将定时器t按到期时间放入时间轮b (需持有b->lock)
+static void wheeladd(struct tbase* b, struct timer* t)
+{
+    uint64 idx = t->expires >> WHEEL_SHIFT;
+
+    // 已经到期的定时器放入当前槽, 下次处理时立即触发
+    if (idx < b->clk)
+        idx = b->clk;
+
+    // 超出时间轮范围的定时器先放在最高层, 下放时再按实际到期时间重新放置
+    uint64 delta = idx - b->clk;
+    if (delta > WHEEL_MAX) {
+        delta = WHEEL_MAX;
+        idx = b->clk + delta;
+    }
+
+    int level = 0;
+    while (delta >= LEVEL_SPAN(level + 1))
+        level++;
+
+    struct timer** head = &b->wheel[level][(idx >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    t->next = *head;
+    t->pprev = head;
+    if (*head)
+        (*head)->pprev = &t->next;
+    *head = t;
+    t->base = b;
+    b->n++;
+}
+
+// 将定时器t移出时间轮 (需持有t->base->lock)
+static void wheeldel(struct timer* t)
+{
+    *t->pprev = t->next;
+    if (t->next)
+        t->next->pprev = t->pprev;
+    t->base->n--;
+    t->base = 0;
+}
+
+// 时钟刚推进到b->clk, 将起点为b->clk的上层槽下放 (需持有b->lock)
+static void cascade(struct tbase* b)
+{
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+        // b->clk不是本层槽的起点, 更高层也不会是
+        if ((b->clk & (LEVEL_SPAN(level) - 1)) != 0)
+            break;
+
+        struct timer** head = &b->wheel[level][(b->clk >> (WHEEL_BITS * level)) & WHEEL_MASK];
+        struct timer* t = *head;
+        *head = 0;
+        while (t) {
+            struct timer* next = t->next;
+            b->n--;
+            b->ncascade++;
+            wheeladd(b, t);
+            t = next;
+        }
+    }
+}
+
+// 触发当前CPU时间轮中已到期的定时器, 返回触发的定时器数
+// trap.c->clockintr 调用 (需关闭中断)
+int timerrun(void)
+{
+    struct tbase* b = &tbases[cpuid()];
+    uint64 now = r_time();
+    uint64 nowclk = now >> WHEEL_SHIFT;
+    int fired = 0;
+
+    acquire(&b->lock);
+    while (b->clk <= nowclk) {
+        // 触发当前槽中已到期的定时器
+        int left = 0;
+        struct timer* t = b->wheel[0][b->clk & WHEEL_MASK];
+        while (t) {
+            struct timer* next = t->next;
+            if (t->expires <= now) {
+                wheeldel(t);
+                b->nfired++;
+                fired++;
+                t->fn(t);
+            } else
+                left = 1;
+            t = next;
+        }
+
+        // 当前槽中还有未到期的定时器 (只可能是nowclk所在的槽), 时钟停在这里
+        if (left)
+            break;
+
+        // 时间轮为空, 直接推进时钟
+        if (b->n == 0) {
+            b->clk = nowclk + 1;
+            break;
+        }
+
+        // 跳过空槽, 但不越过第0层的边界, 边界处需要下放上层的定时器
+        uint64 end = (b->clk | WHEEL_MASK) + 1;
+        if (end > nowclk + 1)
+            end = nowclk + 1;
+        b->clk++;
+        while (b->clk < end && b->wheel[0][b->clk & WHEEL_MASK] == 0)
+            b->clk++;
+        if ((b->clk & WHEEL_MASK) == 0)
+            cascade(b);
+    }
+    release(&b->lock);
+
+    return fired;
+}
+
+// 返回当前CPU时间轮中下一个事件的时间, 没有定时器时返回-1
+// 事件是第0层最早的到期时间, 或者上层下一个非空槽的下放时间
+// trap.c->timerset 调用 (需关闭中断)
+uint64 timernext(void)
+{
+    struct tbase* b = &tbases[cpuid()];
+    uint64 next = -1;
+
+    acquire(&b->lock);
+    if (b->n > 0) {
+        // 第0层的定时器都在 [clk, clk+WHEEL_SLOTS) 内, 第一个非空槽中有最早的定时器
+        for (int i = 0; i < WHEEL_SLOTS; i++) {
+            struct timer* t = b->wheel[0][(b->clk + i) & WHEEL_MASK];
+            if (t == 0)
+                continue;
+            for (; t; t = t->next)
+                if (t->expires < next)
+                    next = t->expires;
+            break;
+        }
+
+        // 上层当前槽已经下放过, 从下一个槽开始找
+        for (int level = 1; level < WHEEL_LEVELS; level++) {
+            uint64 cur = b->clk >> (WHEEL_BITS * level);
+            for (int i = 1; i <= WHEEL_SLOTS; i++) {
+                if (b->wheel[level][(cur + i) & WHEEL_MASK] == 0)
+                    continue;
+                uint64 when = ((cur + i) << (WHEEL_BITS * level)) << WHEEL_SHIFT;
+                if (when < next)
+                    next = when;
+                break;
+            }
+        }
+    }
+    release(&b->lock);
+
+    return next;
+}
+
+static void timerwake(struct timer* t) { wakeup(t); }
+
+// 休眠直到time寄存器达到expires, 只在到期时被唤醒一次
+// 成功返回0, 进程被终止时返回-1
+int timersleep(uint64 expires)
+{
+    // 已经到期, 不必加入时间轮
+    if (expires <= r_time())
+        return 0;
+
+    struct timer t;
+    t.expires = expires;
+    t.fn = timerwake;
+
+    push_off(); //* 禁用中断, 确保不会切换CPU
+    struct tbase* b = &tbases[cpuid()];
+    acquire(&b->lock);
+    pop_off(); //* acquire已经禁用中断
+
+    wheeladd(b, &t);
+
+    // 比当前CPU已设定的定时器中断更早, 提前中断
+    if (expires < r_stimecmp())
+        w_stimecmp(expires);
+
+    // 定时器在持有b->lock时触发, 因此不会丢失唤醒
+    while (t.base != 0) {
+        if (killed(myproc())) {
+            wheeldel(&t);
+            release(&b->lock);
+            return -1;
+        }
+        sleep(&t, &b->lock);
+    }
+    release(&b->lock);
+
+    return 0;
+}
+
+// 打印每个CPU时间轮的统计 (procdump调用, 不使用锁)
+void timerdump(void)
+{
+    printf("timer: cpu pending fired cascade\n");
+    for (int i = 0; i < NCPU; i++) {
+        struct tbase* b = &tbases[i];
+        if (b->n == 0 && b->nfired == 0)
+            continue;
+        printf("  cpu%d: %d %lu %lu\n", i, b->n, b->nfired, b->ncascade);
+    }
+}
@@ -0,0 +1,145 @@
+// 内核事件跟踪
+//
+// 静态跟踪点通过TRACEPOINT宏(defs.h)记录定长的事件到当前CPU的环形缓冲区
+// 类别没有开启时, 跟踪点只判断一次tracemask
+// 写者是关闭中断的本CPU, 读者只移动tail, 因此写入不需要锁 (单写者单读者)
+// 缓冲区满时丢弃新记录, 不覆盖读者可能正在拷贝的旧记录
+//
+// 用户程序读取设备文件/dev/trace取出记录 (user/trace.c)
+// 写入十进制的类别掩码开启跟踪并清空缓冲区, 写入0关闭
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+#include "defs.h"
+#include "trace.h"
+
+#define NTRACEREC 1024 // 每个CPU环形缓冲区的记录数
+
+// 每个CPU的环形缓冲区
+struct tracecpu {
+    uint head;    // 写入位置 (单调增加, 只由本CPU修改)
+    uint tail;    // 读取位置 (只由读者修改)
+    uint64 nrec;  // 记录的事件数
+    uint64 ndrop; // 缓冲区满时丢弃的事件数
+    struct tracerec ring[NTRACEREC];
+} tracecpus[NCPU];
+
+uint tracemask;                 // 开启的类别
+static struct spinlock readlock; // 串行化读者
+
+// 记录一个事件到当前CPU的缓冲区 (TRACEPOINT宏在类别开启时调用)
+void tracerec(int ev, uint64 arg0, uint64 arg1)
+{
+    push_off(); //* 禁用中断, 本CPU是缓冲区唯一的写者
+
+    struct cpu* c = mycpu();
+    struct tracecpu* tc = &tracecpus[cpuid()];
+    uint head = tc->head;
+    if (head - __atomic_load_n(&tc->tail, __ATOMIC_ACQUIRE) >= NTRACEREC) {
+        tc->ndrop++;
+        pop_off();
+        return;
+    }
+
+    struct tracerec* r = &tc->ring[head % NTRACEREC];
+    r->ts = r_time();
+    r->arg0 = arg0;
+    r->arg1 = arg1;
+    r->pid = c->proc ? c->proc->pid : 0;
+    r->cpu = cpuid();
+    r->event = ev;
+
+    // 记录写完之后才对读者可见
+    __atomic_store_n(&tc->head, head + 1, __ATOMIC_RELEASE);
+    tc->nrec++;
+
+    pop_off(); //* 恢复之前的中断状态
+}
+
+// 取出所有CPU缓冲区中的记录, 只返回完整的记录
+// 没有记录时返回0, 不等待
+static int traceread(int user_dst, uint64 dst, int n)
+{
+    struct tracerec r;
+    int tot = 0;
+
+    acquire(&readlock);
+    for (int i = 0; i < NCPU; i++) {
+        struct tracecpu* tc = &tracecpus[i];
+        while (tot + sizeof(r) <= n) {
+            uint tail = tc->tail;
+            if (tail == __atomic_load_n(&tc->head, __ATOMIC_ACQUIRE))
+                break;
+            r = tc->ring[tail % NTRACEREC];
+            __atomic_store_n(&tc->tail, tail + 1, __ATOMIC_RELEASE);
+
+            // 拷贝到用户空间可能发生页错误, 因此不持有锁
+            release(&readlock);
+            if (either_copyout(user_dst, dst + tot, &r, sizeof(r)) < 0)
+                return tot > 0 ? tot : -1;
+            tot += sizeof(r);
+            acquire(&readlock);
+        }
+    }
+    release(&readlock);
+    return tot;
+}
+
+// 写入十进制的类别掩码, 0表示关闭
+// 开启时丢弃缓冲区中的旧记录
+// 不含数字的写入(只有换行符)被忽略, echo分别写入参数和换行符
+static int tracewrite(int user_src, uint64 src, int n)
+{
+    char buf[16];
+    if (n <= 0 || n >= sizeof(buf) || either_copyin(buf, user_src, src, n) < 0)
+        return -1;
+
+    uint mask = 0;
+    int ndigit = 0;
+    for (int i = 0; i < n && buf[i] != '\n'; i++, ndigit++) {
+        if (buf[i] < '0' || buf[i] > '9')
+            return -1;
+        mask = mask * 10 + buf[i] - '0';
+        if (mask >= (1 << NTRACECAT))
+            return -1;
+    }
+    if (ndigit == 0)
+        return n;
+
+    tracemask = 0;
+    if (mask != 0) {
+        acquire(&readlock);
+        for (int i = 0; i < NCPU; i++)
+            __atomic_store_n(&tracecpus[i].tail, __atomic_load_n(&tracecpus[i].head, __ATOMIC_ACQUIRE),
+                __ATOMIC_RELEASE);
+        release(&readlock);
+    }
+    __sync_synchronize();
+    tracemask = mask;
+    return n;
+}
+
+void traceinit(void)
+{
+    initlock(&readlock, "trace");
+
+    devsw[TRACE].read = traceread;
+    devsw[TRACE].write = tracewrite;
+}
+
+// 打印每个CPU的跟踪统计 (procdump调用, 不使用锁)
+void tracedump(void)
+{
+    for (int i = 0; i < NCPU; i++) {
+        struct tracecpu* tc = &tracecpus[i];
+        if (tc->nrec > 0 || tc->ndrop > 0)
+            printf("trace: cpu%d events %lu dropped %lu\n", i, tc->nrec, tc->ndrop);
+    }
+}
@@ -0,0 +1,41 @@
+// 内核事件跟踪的记录格式 (kernel/trace.c, user/trace.c, trace2json.py)
+// 事件编号的高4位是类别, 写入/dev/trace的掩码按类别开启: 第i位对应类别i
+#define TRACE_CAT(ev) ((ev) >> 4)
+
+// 类别0: 系统调用 (syscall.c->syscall)
+#define TR_SYSCALL_ENTER 0x00 // arg0=系统调用号
+#define TR_SYSCALL_EXIT 0x01  // arg0=系统调用号, arg1=返回值
+
+// 类别1: 调度 (proc.c->scheduler)
+#define TR_SWITCH_IN 0x10  // arg0=切换到的进程
+#define TR_SWITCH_OUT 0x11 // arg0=让出CPU的进程, arg1=让出后的状态 (proc.h->procstate)
+
+// 类别2: 休眠与唤醒 (proc.c->sleep/wakeupn)
+#define TR_SLEEP 0x20  // arg0=chan
+#define TR_WAKEUP 0x21 // arg0=chan, arg1=唤醒的进程数
+
+// 类别3: 缓存块 (bio.c)
+#define TR_BREAD 0x30  // arg0=块号, arg1=是否命中缓存
+#define TR_BWRITE 0x31 // arg0=块号
+
+// 类别4: 硬盘 (virtio_disk.c)
+#define TR_DISK_SUBMIT 0x40 // arg0=块号, arg1=是否为写
+#define TR_DISK_DONE 0x41   // arg0=块号
+
+// 类别5: 日志 (log.c)
+#define TR_BEGIN_OP 0x50     // arg0=进行中的文件系统调用数
+#define TR_END_OP 0x51       // arg0=进行中的文件系统调用数
+#define TR_COMMIT_START 0x52 // arg0=日志块数
+#define TR_COMMIT_END 0x53
+
+#define NTRACECAT 6 // 类别数
+
+struct tracerec {
+    uint64 ts;   // time寄存器
+    uint64 arg0; // 事件参数
+    uint64 arg1;
+    int pid;      // 当前进程, 没有时为0
+    uchar cpu;    // 记录的CPU
+    uchar event;  // 事件编号
+    ushort pad;
+};
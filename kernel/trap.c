@@ -6,8 +6,10 @@
 #include "proc.h"
 #include "defs.h"
 
+// tickless: 定时器中断只在需要时发生, ticks根据time寄存器推算
 struct spinlock tickslock; // 定时中断计数锁
-uint ticks;                // 定时器中断计数
+uint ticks;                // 启动以来经过的时钟周期数 (TIMER_INTERVAL)
+uint64 boottime;           // 启动时的time寄存器
 
 extern char trampoline[], uservec[], userret[];
 
@@ -16,7 +18,11 @@ void kernelvec();
 
 extern int devintr();
 
-void trapinit(void) { initlock(&tickslock, "time"); }
+void trapinit(void)
+{
+    initlock(&tickslock, "time");
+    boottime = r_time();
+}
 
 // 设置内核异常处理stvec指向kernelvec
 void trapinithart(void) { w_stvec((uint64)kernelvec); }
@@ -37,6 +43,11 @@ void usertrap(void)
     // 获取用户进程信息
     struct proc* p = myproc();
 
+    // 从上次返回用户态到现在计为用户态时间
+    uint64 now = r_time();
+    p->acct.utime += now - p->tstamp;
+    p->tstamp = now;
+
     // 保存用户PC
     p->trapframe->epc = r_sepc();
 
@@ -48,6 +59,7 @@ void usertrap(void)
 
         // 将用户PC更新为ecall的下一条指令
         p->trapframe->epc += 4;
+        p->acct.nsyscall++;
 
         // sepc, scause, sstatus已经处理完毕
         intr_on(); // 重新开启中断
@@ -60,6 +72,11 @@ void usertrap(void)
 
     }
 
+    // 如果是读取/写入页错误, 尝试处理延迟分配页或写时复制页
+    else if ((r_scause() == 13 || r_scause() == 15) && vmfault(p->pagetable, r_stval(), r_scause() == 15, true) == 0) {
+
+    }
+
     else {
         printf("usertrap(): unexpected scause 0x%lx pid=%d\n", r_scause(), p->pid);
         printf("            sepc=0x%lx stval=0x%lx\n", r_sepc(), r_stval());
@@ -69,7 +86,7 @@ void usertrap(void)
     if (killed(p))
         exit(-1);
 
-    // 如果是定时器中断, 就让出CPU
+    // 如果是需要让出CPU的定时器中断, 就让出CPU
     if (which_dev == 2)
         yield();
 
@@ -86,6 +103,11 @@ void usertrapret(void)
     // 所以要在返回到用户空间之前关闭中断
     intr_off();
 
+    // 从陷入或被调度到现在计为内核态时间
+    uint64 now = r_time();
+    p->acct.stime += now - p->tstamp;
+    p->tstamp = now;
+
     // 设置用户异常处理stvec指向uservec (trampoline.S)
     uint64 trampoline_uservec = TRAMPOLINE + (uservec - trampoline);
     w_stvec(trampoline_uservec);
@@ -105,8 +127,11 @@ void usertrapret(void)
     // 设置sret将跳转到的用户PC
     w_sepc(p->trapframe->epc);
 
-    // 设置用户页表寄存器为 {Sv39, p->pagetable}
-    uint64 satp = MAKE_SATP(p->pagetable);
+    // 当前线程trapframe的用户虚拟地址, userret和下次陷入时的uservec使用
+    w_sscratch(p->trapva);
+
+    // 设置用户页表寄存器为 {Sv39, ASID, p->pagetable}
+    uint64 satp = uvmsatp(p);
 
     // 执行 trampoline.S->userret(satp)
     uint64 trampoline_userret = TRAMPOLINE + (userret - trampoline);
@@ -126,7 +151,17 @@ void kerneltrap()
     if (intr_get() != 0)
         panic("kerneltrap: interrupts enabled");
 
-    if ((which_dev = devintr()) == 0) {
+    // kernelvec不修改s0, 因此本函数栈帧中保存的上一个帧指针就是被中断代码的
+    mycpu()->trapfp = *(uint64*)(r_fp() - 16);
+
+    // 如果是ucopy.S通过用户窗口访问用户内存时的页错误
+    // 无法处理时跳转到ucopy_fault, 使copyin/copyout返回-1
+    if ((scause == 13 || scause == 15) && ucopyfixup(sepc) != 0) {
+        if (uwinfault(r_stval(), scause == 15) < 0)
+            sepc = ucopyfixup(sepc);
+    }
+
+    else if ((which_dev = devintr()) == 0) {
         // interrupt or trap from an unknown source
         printf("scause=0x%lx sepc=0x%lx stval=0x%lx\n", scause, r_sepc(), r_stval());
         panic("kerneltrap");
@@ -142,24 +177,53 @@ void kerneltrap()
     w_sstatus(sstatus);
 }
 
+// 根据time寄存器推进ticks (需持有tickslock)
+void ticksync(void) { ticks = (r_time() - boottime) / TIMER_INTERVAL; }
+
+// 为当前CPU设定下一次定时器中断 (需关闭中断)
+// 运行进程时: 时间片结束和本CPU时间轮的下一个事件中较早者
+// 空闲时: 只在时间轮的下一个事件唤醒, 没有则不设定
+void timerset(int busy)
+{
+    uint64 next = timernext();
+    if (busy && mycpu()->sliceend < next)
+        next = mycpu()->sliceend;
+
+    // 采样分析器开启时, 运行进程的CPU按采样间隔中断
+    if (busy && profnext() < next)
+        next = profnext();
+
+    w_stimecmp(next);
+}
+
 // 定时器中断处理
 // trap.c->devintr 跳转到这里
-void clockintr()
+// 返回1表示正在运行的进程应当让出CPU: 时间片已经用完, 或者有定时器到期唤醒了进程
+// 只是采样或下放定时器的中断不打断时间片
+int clockintr()
 {
-    // 唤醒睡眠进程 (sysproc.c->sys_sleep)
-    if (cpuid() == 0) {
-        acquire(&tickslock);
-        ticks++;
-        wakeup(&ticks);
-        release(&tickslock);
-    }
+    struct cpu* c = mycpu();
+    c->ntimer++;
+
+    acquire(&tickslock);
+    ticksync();
+    release(&tickslock);
 
-    // 设置下一次定时器中断(大约是1秒)
-    w_stimecmp(r_time() + 1000000);
+    // 触发本CPU时间轮中到期的定时器, 唤醒各自的睡眠进程 (timer.c->timersleep)
+    int fired = timerrun();
+
+    // 采样分析器开启时记录被中断的位置
+    proftick();
+
+    // 设置下一次定时器中断
+    // 时间片用完的进程随后会让出CPU, 调度器会重新设定时间片
+    timerset(c->proc != 0);
+
+    return c->proc != 0 && (fired > 0 || r_time() >= c->sliceend);
 }
 
 // 判断并处理 当前的设备中断
-// 定时器中断:2  其他设备中断:1  未知中断:0
+// 需要让出CPU的定时器中断:2  其他设备中断 (包括其余定时器中断):1  未知中断:0
 // usertrap, kerneltrap 跳转到这里
 int devintr()
 {
@@ -192,8 +256,16 @@ int devintr()
 
     // 如果是定时器中断
     else if (scause == 0x8000000000000005L) {
-        clockintr();
-        return 2;
+        return clockintr() ? 2 : 1;
+    }
+
+    // 如果是软件中断 (核间中断, kernelvec.S->mipivec)
+    // 用于唤醒空闲CPU (由调度器检查运行队列), 以及TLB shootdown (vm.c->uvmflush)
+    else if (scause == 0x8000000000000001L) {
+        w_sip(r_sip() & ~SIP_SSIP);
+        mycpu()->nipi++;
+        tlbsync();
+        return 1;
     }
 
     else
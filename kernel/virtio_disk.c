@@ -4,7 +4,7 @@
 //  -------------------------------------------------
 //  + FS.img: 文件系统映像 (mkfs.c)
 //  + VirtIO: 虚拟硬盘驱动 (virtio.h virtio_disk.c)
-//  + BCache: LRU缓存链环 (buf.h bio.c)
+//  + BCache: LRU缓存哈希表 (buf.h bio.c)
 //  + Log: 两步提交的日志系统 (log.c)
 //  + Inode Dir Path: 硬盘文件系统实现 (stat.h fs.h fs.c)
 //  + Pipe: 管道实现 (pipe.c)
@@ -30,6 +30,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "trace.h"
 
 // VirtIO寄存器的内存地址
 #define R(r) ((volatile uint32*)(VIRTIO0 + (r)))
@@ -293,6 +294,7 @@ void virtio_disk_rw(struct buf* b, int write)
     __sync_synchronize(); // 内存屏障
 
     // 通知设备有新的可用请求 (队列编号)
+    TRACEPOINT(TR_DISK_SUBMIT, b->blockno, write);
     *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0;
 
     // 休眠等待硬盘中断 virtio_disk_intr() 通知请求已完成
@@ -331,6 +333,7 @@ void virtio_disk_intr()
 
         struct buf* b = disk.info[id].b;
         b->disk = false; // 处理结束, 硬盘释放buf
+        TRACEPOINT(TR_DISK_DONE, b->blockno, 0);
         wakeup(b);       // 唤醒正在等待该buf的进程
 
         // 继续处理下一个请求
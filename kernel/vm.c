@@ -3,25 +3,59 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 
 // 内核页表
 pagetable_t kernel_pagetable;
 
+// ASID分配器 (代际回收)
+// 每个地址空间使用一对ASID: 2n标记用户页表, 2n+1标记内核页表 (两者以不同方式映射低地址)
+// ASID 0 标记全局内核页表, 由scheduler使用
+// 编号用完时进入新的一代: 所有进程在下次被调度时重新分配编号,
+// 每个CPU在下次切换到进程之前刷新整个TLB
+struct {
+    struct spinlock lock;
+    uint64 gen;       // 当前代数 (从1开始)
+    uint64 next;      // 下一个可分配的编号
+    uint64 max;       // 最大编号, 为0表示硬件不支持ASID (每次切换都刷新整个TLB)
+    char flush[NCPU]; // 该CPU需要在下次切换前刷新整个TLB
+} asids;
+
+#define ASIDNUM(mm) ((mm)->asid & 0xFFFF)
+#define KASID(mm) (ASIDNUM(mm) * 2 + 1) // 内核页表的ASID
+#define TLBFLUSHMAX 32                  // 超过此页数时刷新整个ASID, 而不是逐页刷新
+
+// TLB刷新统计
+struct {
+    uint64 full;      // 刷新整个TLB的次数
+    uint64 targeted;  // 只刷新指定地址或ASID的次数
+    uint64 shootdown; // 通过核间中断让其他CPU刷新的次数
+} tlbstat[NCPU];
+
+// 当前CPU正在使用的内核页表ASID (从satp读取, 全局内核页表为0)
+// 地址空间的ASID在其他CPU上被重新分配后, 本CPU在下次切换前仍使用旧的编号
+static inline uint64 curkasid(void) { return (r_satp() & SATP_ASID_MASK) >> SATP_ASID_SHIFT; }
+
 // 内核程序代码段结束地址 (kernel.ld)
 extern char etext[];
 
 extern char trampoline[]; // trampoline.S
 
-// 创建内核页表 (大部分直接映射)
+// ucopy.S
+extern char ucopy_start[], ucopy_end[], ucopy_fault[];
+extern int ucopy(void* dst, void* src, uint64 len);
+extern int ucopystr(char* dst, char* src, uint64 max);
+
+// 创建内核页表 (大部分直接映射, 2MB对齐的部分使用大页)
 pagetable_t kvmmake(void)
 {
     pagetable_t kpgtbl;
 
-    // 分配并清空页表空间
-    kpgtbl = (pagetable_t)kalloc();
-    memset(kpgtbl, 0, PGSIZE);
+    // 分配清零的页表空间
+    kpgtbl = (pagetable_t)kalloc_zeroed();
 
     // UART寄存器 va=UART0, pa=UART0, size=PGSIZE, perm=可读可写
     kvmmap(kpgtbl, UART0, UART0, PGSIZE, PTE_R | PTE_W);
@@ -29,6 +63,9 @@ pagetable_t kvmmake(void)
     // VirtIO设备 va=VIRTIO0, pa=VIRTIO0, size=PGSIZE, perm=可读可写
     kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
+    // CLINT的msip寄存器 (发送核间中断) va=CLINT, pa=CLINT, size=PGSIZE*4, perm=可读可写
+    kvmmap(kpgtbl, CLINT, CLINT, PGSIZE * 4, PTE_R | PTE_W);
+
     // PLIC控制器 va=PLIC, pa=PLIC, size=0x4000000, perm=可读可写
     kvmmap(kpgtbl, PLIC, PLIC, 0x4000000, PTE_R | PTE_W);
 
@@ -40,11 +77,9 @@ pagetable_t kvmmake(void)
 
     // 映射trampoline页到内核最高虚拟地址 va=TRAMPOLINE, pa=trampoline, size=PGSIZE,
     // perm=可读可执行
+    // 进程的内核栈在进程结构体分配时映射到其下方 (kvmmapstack)
     kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-    // 为每个进程分配并映射一个内核栈
-    proc_mapstacks(kpgtbl);
-
     return kpgtbl;
 }
 
@@ -59,6 +94,197 @@ void kvminithart()
     sfence_vma();
 }
 
+// 将新分配的内核栈页pa映射到内核页表的va (proc.c->procnew)
+// 内核栈与trampoline页位于同一个第2级页表项之下, 进程内核页表复制的是该项 (kvmcreate),
+// 因此共享同一个第1级页表, 新的映射对所有进程的内核页表立即可见
+// 成功返回0, 内存不足返回-1
+int kvmmapstack(uint64 va, uint64 pa)
+{
+    if (PX(2, va) != PX(2, TRAMPOLINE))
+        panic("kvmmapstack");
+
+    // va=va, pa=pa, size=PGSIZE, perm=可读可写
+    if (mappages(kernel_pagetable, va, PGSIZE, pa, PTE_R | PTE_W) != 0)
+        return -1;
+
+    // 每个CPU在下次切换到进程前刷新整个TLB, 不依赖硬件不缓存无效页表项
+    acquire(&asids.lock);
+    for (int i = 0; i < NCPU; i++)
+        asids.flush[i] = true;
+    release(&asids.lock);
+    return 0;
+}
+
+// 检测硬件支持的ASID位数, 初始化ASID分配器 (CPU0启动时调用)
+void asidinit(void)
+{
+    initlock(&asids.lock, "asid");
+
+    // 向satp.ASID写入全1, 读回的值只保留硬件实现的位
+    uint64 satp = r_satp();
+    w_satp(satp | SATP_ASID_MASK);
+    uint64 bits = (r_satp() & SATP_ASID_MASK) >> SATP_ASID_SHIFT;
+    w_satp(satp);
+
+    asids.gen = 1;
+    asids.next = 1;
+    asids.max = bits > 1 ? (bits + 1) / 2 - 1 : 0;
+}
+
+// 切换当前CPU的页表 (scheduler调用, 持有p->lock)
+// p非空时切换到进程的内核页表, 如果地址空间的ASID属于旧的一代则重新分配
+// p为空时切换回全局内核页表, 它的映射从不改变, 因此无需刷新
+void kvmswitch(struct proc* p)
+{
+    int id = cpuid();
+
+    if (p == 0) {
+        w_satp(MAKE_SATP(kernel_pagetable));
+        return;
+    }
+
+    // 硬件不支持ASID, 只能刷新整个TLB
+    if (asids.max == 0) {
+        w_satp(MAKE_SATP(p->kpagetable));
+        __sync_fetch_and_and(&p->mm->tlbstale, ~(1UL << id));
+        sfence_vma();
+        tlbstat[id].full++;
+        return;
+    }
+
+    struct mm* mm = p->mm;
+    acquire(&asids.lock);
+    if ((mm->asid >> 16) != asids.gen) {
+        // 编号用完, 进入新的一代
+        if (asids.next > asids.max) {
+            asids.gen++;
+            asids.next = 1;
+            for (int i = 0; i < NCPU; i++)
+                asids.flush[i] = true;
+        }
+        // 本代新分配的编号不会残留在任何CPU的TLB中
+        // 不清除tlbstale: 其他CPU可能仍以旧编号运行该地址空间的线程, 正在等待它们刷新
+        mm->asid = (asids.gen << 16) | asids.next++;
+    }
+    int flush = asids.flush[id];
+    asids.flush[id] = false;
+    release(&asids.lock);
+
+    w_satp(MAKE_SATP_ASID(p->kpagetable, KASID(mm)));
+
+    // 先清除标记再检查, 与uvmflush中先标记再检查c->proc的顺序配合
+    uint64 stale = __sync_fetch_and_and(&mm->tlbstale, ~(1UL << id));
+    if (flush) {
+        sfence_vma();
+        tlbstat[id].full++;
+    } else if (stale & (1UL << id)) {
+        // 地址空间的页表在其他CPU上被修改过, 刷新本CPU上该地址空间的TLB项
+        sfence_vma_asid(KASID(mm) - 1);
+        sfence_vma_asid(KASID(mm));
+        tlbstat[id].targeted++;
+    }
+}
+
+// 返回进程用户页表的satp值 (usertrapret调用, 关闭中断)
+// 用户ASID与当前CPU正在使用的内核ASID配对
+uint64 uvmsatp(struct proc* p)
+{
+    uint64 kasid = curkasid();
+    return MAKE_SATP_ASID(p->pagetable, kasid ? kasid - 1 : 0);
+}
+
+// 刷新当前CPU上ASID kasid对应的地址空间的TLB项
+static void tlbflushlocal(uint64 kasid, uint64 va)
+{
+    int id = cpuid();
+    if (asids.max == 0 || kasid == 0) {
+        sfence_vma();
+        tlbstat[id].full++;
+    } else if (va == -1) {
+        sfence_vma_asid(kasid - 1);
+        sfence_vma_asid(kasid);
+        tlbstat[id].targeted++;
+    } else {
+        sfence_vma_page(va, kasid - 1);
+        sfence_vma_page(UWINBASE + va, kasid);
+        tlbstat[id].targeted++;
+    }
+}
+
+// 修改当前进程的用户页表后刷新TLB
+// va为页地址时只刷新该页 (用户页表和用户窗口), va为-1时刷新地址空间的所有TLB项
+// 其他CPU上的过时TLB项:
+//   正在运行同一地址空间的线程的CPU, 通过核间中断立即刷新, 并等待它们完成 (TLB shootdown)
+//   其他CPU在下次切换到该地址空间时刷新 (kvmswitch)
+// pagetable不是当前进程的页表时无需刷新: 它尚未被任何CPU使用, 或进程已经退出
+void uvmflush(pagetable_t pagetable, uint64 va)
+{
+    struct proc* p = myproc();
+    if (p == 0 || pagetable != p->pagetable)
+        return;
+
+    struct mm* mm = p->mm;
+    push_off(); //* 禁用中断, 确保不会切换CPU
+    int id = cpuid();
+    tlbflushlocal(curkasid(), va);
+    __sync_fetch_and_or(&mm->tlbstale, ~(1UL << id));
+
+    // 只有一个线程时, 其他CPU不可能正在运行这个地址空间
+    if (mm->ref > 1) {
+        uint64 wait = 0;
+        for (int i = 0; i < NCPU; i++) {
+            struct proc* q = cpus[i].proc;
+            if (i != id && q != 0 && q->mm == mm) {
+                wait |= 1UL << i;
+                *(volatile uint32*)CLINT_MSIP(i) = 1;
+                tlbstat[id].shootdown++;
+            }
+        }
+
+        // 等待目标CPU清除标记, 或者不再运行这个地址空间
+        // 等待期间处理发给本CPU的刷新请求, 避免两个CPU互相等待
+        while (wait) {
+            for (int i = 0; i < NCPU; i++) {
+                if ((wait & (1UL << i)) == 0)
+                    continue;
+                struct proc* q = cpus[i].proc;
+                if ((mm->tlbstale & (1UL << i)) == 0 || q == 0 || q->mm != mm)
+                    wait &= ~(1UL << i);
+            }
+            tlbsync();
+        }
+    }
+    pop_off(); //* 恢复之前的中断状态
+}
+
+// 处理其他CPU的TLB shootdown请求 (核间中断, 以及acquire自旋时调用, 需关闭中断)
+// 当前CPU运行的地址空间被标记为过时时, 刷新其TLB项
+void tlbsync(void)
+{
+    struct proc* p = mycpu()->proc;
+    if (p == 0 || p->mm == 0)
+        return;
+
+    struct mm* mm = p->mm;
+    uint64 bit = 1UL << cpuid();
+    if ((mm->tlbstale & bit) == 0)
+        return;
+
+    // 先清除标记再刷新, 刷新之后的修改会重新设置标记
+    __sync_fetch_and_and(&mm->tlbstale, ~bit);
+    tlbflushlocal(curkasid(), -1);
+}
+
+// 打印TLB刷新统计 (procdump调用, 不使用锁)
+void tlbdump(void)
+{
+    printf("tlb: asid gen %lu next %lu max %lu\n", asids.gen, asids.next, asids.max);
+    for (int i = 0; i < NCPU; i++)
+        if (tlbstat[i].full || tlbstat[i].targeted)
+            printf("  cpu%d: full %lu targeted %lu shootdown %lu\n", i, tlbstat[i].full, tlbstat[i].targeted,
+                tlbstat[i].shootdown);
+}
+
 // https://learningos.cn/uCore-Tutorial-Guide-2022S/_images/sv39-full.png
 // Sv39有三级页表, 每个页表页包含512个64位PTE
 //   63:39 -- 全零
@@ -67,40 +293,163 @@ void kvminithart()
 //   20:12 -- 第0级页表索引 (9 bits)
 //   11:0  -- 页内偏移 (12 bits)
 
-// 查找页表, 返回虚拟地址va 对应的页表项
+// 为进程创建内核页表
+// 第2级索引0~255共享内核页表的映射, 256~511作为用户窗口共享用户页表的映射
+pagetable_t kvmcreate(pagetable_t pagetable)
+{
+    pagetable_t kpgtbl = (pagetable_t)kalloc();
+    if (kpgtbl == 0)
+        return 0;
+
+    memmove(kpgtbl, kernel_pagetable, PGSIZE / 2);
+    kvmuwin(kpgtbl, pagetable);
+    return kpgtbl;
+}
+
+// 将进程内核页表的用户窗口指向用户页表pagetable
+// 用户页表之后新建的第2级页表项, 在访问时由uwinfault同步
+void kvmuwin(pagetable_t kpgtbl, pagetable_t pagetable) { memmove(kpgtbl + 256, pagetable, PGSIZE / 2); }
+
+// 处理内核通过用户窗口访问用户内存时的页错误 (kerneltrap调用)
+// 同步用户页表新建的第2级页表项, 或按用户页错误分配页
+// 处理成功返回0 (重新执行访问指令), 否则返回-1
+int uwinfault(uint64 kva, int write)
+{
+    struct proc* p = myproc();
+    if (p == 0 || p->kpagetable == 0 || kva < UWINBASE || kva - UWINBASE >= MMAPTOP)
+        return -1;
+
+    uint64 va = kva - UWINBASE;
+    pte_t* kpde = &p->kpagetable[PX(2, kva)];
+    pte_t* upde = &p->pagetable[PX(2, va)];
+    int fixed = false;
+
+    // 用户页表新建了第2级页表项
+    if (*kpde != *upde) {
+        *kpde = *upde;
+        fixed = true;
+    }
+
+    // 用户页尚未分配, 或需要写时复制
+    pte_t* pte = walk(p->pagetable, va, false);
+    if (pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 || (*pte & (write ? PTE_W : PTE_R)) == 0) {
+        if (vmfault(p->pagetable, va, write, false) < 0)
+            return -1;
+        *kpde = *upde;
+        fixed = true;
+    }
+
+    if (!fixed)
+        return -1;
+    uvmflush(p->pagetable, va);
+    return 0;
+}
+
+// 页错误是否发生在ucopy.S中, 是则返回恢复地址
+uint64 ucopyfixup(uint64 sepc)
+{
+    if (sepc >= (uint64)ucopy_start && sepc < (uint64)ucopy_end)
+        return (uint64)ucopy_fault;
+    return 0;
+}
+
+// 能否通过用户窗口直接访问当前进程的用户地址 [va, va+len)
+static int uwin(pagetable_t pagetable, uint64 va, uint64 len)
+{
+#ifdef SWCOPY
+    return false;
+#else
+    struct proc* p = myproc();
+    return p != 0 && pagetable == p->pagetable && va + len >= va && va + len <= MMAPTOP;
+#endif
+}
+
+// 第0级页表是否为空 (所有页表项都无效)
+static int ptempty(pagetable_t pagetable)
+{
+    for (int i = 0; i < 512; i++)
+        if (pagetable[i] & PTE_V)
+            return false;
+    return true;
+}
+
+// 查找页表, 返回虚拟地址va 在第*level级(0或1)的页表项
+// 途中遇到更高级别的叶子项(大页)时, 直接返回该叶子项
+// 要求第1级页表项时, 如果它指向的第0级页表为空(alloc为真时)则释放该页表,
+// 否则返回第0级页表项
+// *level返回页表项实际所在的级别
 // alloc  1:分配新页表  0:不进行分配
-pte_t* walk(pagetable_t pagetable, uint64 va, int alloc)
+static pte_t* walklevel(pagetable_t pagetable, uint64 va, int alloc, int* level)
 {
     if (va >= MAXVA)
         panic("walk");
 
-    for (int level = 2; level > 0; level--) {
-        // 获取pagetable页表中, va的第level级索引项
-        pte_t* pte = &pagetable[PX(level, va)];
+    for (int l = 2; l > *level; l--) {
+        // 获取pagetable页表中, va的第l级索引项
+        pte_t* pte = &pagetable[PX(l, va)];
 
-        // 如果是有效项, 则获取下一级页表
-        if (*pte & PTE_V)
+        // 如果是有效项
+        if (*pte & PTE_V) {
+            // 叶子项 (大页), 直接返回
+            if (*pte & (PTE_R | PTE_W | PTE_X)) {
+                *level = l;
+                return pte;
+            }
+            // 获取下一级页表
             pagetable = (pagetable_t)PTE2PA(*pte);
+        }
 
         // 如果不是有效项
         else {
-            // 给下一级页表分配一页内存
-            pagetable = (pde_t*)kalloc();
-
-            // 确保alloc为真 且分配成功
-            if (!alloc || (pagetable == 0))
+            // 确保alloc为真, 并给下一级页表分配一页清零内存
+            if (!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0)
                 return 0;
 
-            // 清空页表
-            memset(pagetable, 0, PGSIZE);
-
             // 填充页表项, 指向新分配的下一级页表
             *pte = PA2PTE(pagetable) | PTE_V;
         }
     }
 
-    // 返回最后一级页表项的地址
-    return &pagetable[PX(0, va)];
+    pte_t* pte = &pagetable[PX(*level, va)];
+
+    // 第1级页表项已经指向第0级页表, 只能使用第0级页表项
+    // 放置大页之前由uvmdetach移除空的第0级页表
+    if (*level == 1 && (*pte & PTE_V) && (*pte & (PTE_R | PTE_W | PTE_X)) == 0) {
+        pagetable_t child = (pagetable_t)PTE2PA(*pte);
+        *level = 0;
+        return &child[PX(0, va)];
+    }
+    return pte;
+}
+
+// 移除va所在2MB区域的第0级页表, 以便放置大页 (需持有mm->lock)
+// 第0级页表为空(之前的映射已被移除)或不存在时返回0, 仍有映射时返回-1
+// 其他CPU的TLB可能缓存了指向它的非叶子项, 刷新TLB之后才释放页表页
+int uvmdetach(pagetable_t pagetable, uint64 va)
+{
+    int level = 1;
+    pte_t* pte = walklevel(pagetable, va, false, &level);
+    if (pte == 0 || level == 1)
+        return 0;
+
+    // walklevel返回了第0级页表项, 取得指向该页表的第1级页表项
+    pte_t* pde = &((pagetable_t)PTE2PA(pagetable[PX(2, va)]))[PX(1, va)];
+    pagetable_t child = (pagetable_t)PTE2PA(*pde);
+    if (!ptempty(child))
+        return -1;
+
+    *pde = 0;
+    uvmflush(pagetable, -1);
+    kfree((void*)child);
+    return 0;
+}
+
+// 查找页表, 返回虚拟地址va 对应的叶子页表项 (可能是大页的第1级页表项)
+// alloc  1:分配新页表  0:不进行分配
+pte_t* walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+    int level = 0;
+    return walklevel(pagetable, va, alloc, &level);
 }
 
 // 查找用户页表, 返回虚拟地址va 对应的物理地址
@@ -108,12 +457,13 @@ uint64 walkaddr(pagetable_t pagetable, uint64 va)
 {
     pte_t* pte;
     uint64 pa;
+    int level = 0;
 
     if (va >= MAXVA)
         return 0;
 
-    // 返回va对应的最后一级页表项
-    pte = walk(pagetable, va, false);
+    // 返回va对应的叶子页表项
+    pte = walklevel(pagetable, va, false, &level);
 
     // 确保页表项存在
     if (pte == 0)
@@ -125,7 +475,10 @@ uint64 walkaddr(pagetable_t pagetable, uint64 va)
     if ((*pte & PTE_U) == 0)
         return 0;
 
+    // 大页需要加上va所在页在大页内的偏移
     pa = PTE2PA(*pte);
+    if (level == 1)
+        pa += PGROUNDDOWN(va) - MEGAROUNDDOWN(va);
     return pa;
 }
 
@@ -140,6 +493,7 @@ void kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 // pagetable: 首级页表所在的物理页地址
 // va: 开始的虚拟地址  size: 映射的总大小 (字节)
 // pa: 开始的物理地址  perm: 页表项的权限 (riscv.h)
+// va和pa都按2MB对齐的部分使用大页映射
 int mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 {
     uint64 a, last;
@@ -156,9 +510,15 @@ int mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
     a = va;                    // 首个虚拟页地址
     last = va + size - PGSIZE; // 末个虚拟页地址
     for (;;) {
-        // 获取va对应的最后一级页表项 (如果不存在, 则逐级创建)
-        if ((pte = walk(pagetable, a, true)) == 0)
+        // 虚拟地址和物理地址都按2MB对齐, 并且剩余长度足够时, 使用大页
+        int level = 0;
+        if (a % MEGAPGSIZE == 0 && pa % MEGAPGSIZE == 0 && last - a >= MEGAPGSIZE - PGSIZE)
+            level = 1;
+
+        // 获取va对应的第level级页表项 (如果不存在, 则逐级创建)
+        if ((pte = walklevel(pagetable, a, true, &level)) == 0)
             return -1;
+        uint64 sz = level == 1 ? MEGAPGSIZE : PGSIZE;
 
         // 确保此页表项 未映射物理地址
         if (*pte & PTE_V)
@@ -168,59 +528,103 @@ int mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
         *pte = PA2PTE(pa) | perm | PTE_V;
 
         // 如果所有页都映射完毕, 则退出
-        if (a == last)
+        if (last - a < sz)
             break;
 
         // 继续设置下一页
-        a += PGSIZE;
-        pa += PGSIZE;
+        a += sz;
+        pa += sz;
     }
     return 0;
 }
 
-// 移除从va开始的npages映射 va必须页对齐 映射必须存在
+// 释放uvmunmap移除的物理页, 最低位标记2MB大页
+static void unmapfree(uint64* pas, int n)
+{
+    for (int i = 0; i < n; i++) {
+        void* pa = (void*)(pas[i] & ~(PGSIZE - 1));
+        if (pas[i] & 1)
+            kfree_pages(pa, MEGAPGORDER);
+        else
+            kfree(pa);
+    }
+}
+
+// 移除从va开始的npages映射 va必须页对齐
+// 延迟分配的堆中可能存在尚未映射的页, 直接跳过
 // do_free 1:释放物理内存  0:不进行释放
+// 物理页在TLB刷新之后才释放, 否则其他CPU上的线程仍可能通过过时的TLB项写入已释放的页
 void uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
     pte_t* pte;
+    uint64 pas[TLBFLUSHMAX]; // 等待刷新TLB后释放的物理页
+    int npa = 0;
+    uint64 stale = 0; // 上次刷新后清空的页表项数
 
     // 确保va页对齐
     if ((va % PGSIZE) != 0)
         panic("uvmunmap: not aligned");
 
     // 遍历所有va
-    for (uint64 a = va; a < va + npages * PGSIZE; a += PGSIZE) {
-        // 确保页表项存在
-        if ((pte = walk(pagetable, a, false)) == 0)
-            panic("uvmunmap: walk");
-
-        // 确保页表项有效
+    uint64 end = va + npages * PGSIZE;
+    uint64 sz;
+    for (uint64 a = va; a < end; a += sz) {
+        int level = 0;
+        sz = PGSIZE;
+
+        // 跳过尚未分配的页
+        if ((pte = walklevel(pagetable, a, false, &level)) == 0)
+            continue;
         if ((*pte & PTE_V) == 0)
-            panic("uvmunmap: not mapped");
+            continue;
 
         // 确保是叶子页项 (存在RWX位)
         if (PTE_FLAGS(*pte) == PTE_V)
             panic("uvmunmap: not a leaf");
 
-        // 如果需要释放物理内存, 则释放
-        if (do_free) {
-            uint64 pa = PTE2PA(*pte);
-            kfree((void*)pa);
+        // 大页只能整体移除
+        if (level == 1) {
+            if (a % MEGAPGSIZE != 0 || end - a < MEGAPGSIZE)
+                panic("uvmunmap: partial megapage");
+            sz = MEGAPGSIZE;
         }
 
-        // 清空页表项
+        // 清空页表项, 少量页时逐页刷新TLB
+        uint64 pa = PTE2PA(*pte) | (level == 1);
         *pte = 0;
+        if (npages <= TLBFLUSHMAX) {
+            uvmflush(pagetable, a);
+            if (do_free)
+                unmapfree(&pa, 1);
+            continue;
+        }
+        stale++;
+
+        // 大量页时每攒满一批, 刷新进程的所有TLB项后再释放
+        if (do_free) {
+            pas[npa++] = pa;
+            if (npa == TLBFLUSHMAX) {
+                uvmflush(pagetable, -1);
+                unmapfree(pas, npa);
+                npa = 0;
+                stale = 0;
+            }
+        }
     }
+
+    // 刷新剩余的页
+    if (stale > 0)
+        uvmflush(pagetable, -1);
+    unmapfree(pas, npa);
 }
 
 // 分配并清空一个用户页表
 pagetable_t uvmcreate()
 {
     pagetable_t pagetable;
-    pagetable = (pagetable_t)kalloc();
+    pagetable = (pagetable_t)kalloc_zeroed();
     if (pagetable == 0)
         return 0;
-    memset(pagetable, 0, PGSIZE);
     return pagetable;
 }
 
@@ -233,9 +637,8 @@ void uvmfirst(pagetable_t pagetable, uchar* initcode, uint sz)
     if (sz >= PGSIZE)
         panic("uvmfirst: more than a page");
 
-    // 分配并清空一页内存
-    mem = kalloc();
-    memset(mem, 0, PGSIZE);
+    // 分配一页清零内存
+    mem = kalloc_zeroed();
 
     // va=0, pa=mem, size=PGSIZE, perm=可读可写可执行 (用户权限)
     mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W | PTE_R | PTE_X | PTE_U);
@@ -257,13 +660,12 @@ uint64 uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
     oldsz = PGROUNDUP(oldsz);
 
     for (uint64 a = oldsz; a < newsz; a += PGSIZE) {
-        // 分配一页新内存并清空
-        mem = kalloc();
+        // 分配一页清零内存
+        mem = kalloc_zeroed();
         if (mem == 0) {
             uvmdealloc(pagetable, a, oldsz);
             return 0;
         }
-        memset(mem, 0, PGSIZE);
 
         // 将新内存映射到页表
         // va=a, pa=mem, size=PGSIZE, perm=可读可写可执行
@@ -323,49 +725,189 @@ void uvmfree(pagetable_t pagetable, uint64 sz)
     freewalk(pagetable); // 递归释放无叶子项的页表页
 }
 
-// 给定父进程的页表, 将其内存复制到子进程的页表中
-// 既复制页表页, 又复制物理内存页
-int uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
+// 给定父进程的页表, 将其内存以写时复制的方式共享给子进程的页表
+int uvmcopy(pagetable_t old, pagetable_t new, uint64 sz) { return uvmshare(old, new, 0, sz, true); }
+
+// 将old页表中 [va, va+len) 的物理页映射到new页表 (va页对齐)
+// 只复制页表页, 物理内存页增加引用计数后由双方共享
+// cow为真时, 可写页在双方都改为只读并标记PTE_COW, 写入时由uvmcow复制
+// 父进程返回用户态时trampoline会刷新TLB, 使只读权限生效
+// 大页不做写时复制, cow为真时立即复制整个大页
+int uvmshare(pagetable_t old, pagetable_t new, uint64 va, uint64 len, int cow)
 {
-    uint64 i;
-    for (i = 0; i < sz; i += PGSIZE) {
-        // 确保页表项存在
+    uint64 i, sz;
+    int downgraded = false;
+    for (i = va; i < va + len; i += sz) {
+        // 跳过尚未分配的页, 访问时再分配
         pte_t* pte;
-        if ((pte = walk(old, i, false)) == 0)
-            panic("uvmcopy: pte should exist");
-
-        // 确保页表项有效
+        int level = 0;
+        sz = PGSIZE;
+        if ((pte = walklevel(old, i, false, &level)) == 0)
+            continue;
         if ((*pte & PTE_V) == 0)
-            panic("uvmcopy: page not present");
+            continue;
+
+        // 大页: 共享映射直接共享物理页, 私有映射立即复制整个大页
+        if (level == 1) {
+            uint64 pa = PTE2PA(*pte);
+            uint flags = PTE_FLAGS(*pte);
+            sz = MEGAPGSIZE;
+            if (i % MEGAPGSIZE != 0)
+                panic("uvmshare: megapage");
+
+            if (cow) {
+                char* mem = kalloc_pages(MEGAPGORDER);
+                if (mem == 0)
+                    goto err;
+                memmove(mem, (char*)pa, MEGAPGSIZE);
+                if (mappages(new, i, MEGAPGSIZE, (uint64)mem, flags) != 0) {
+                    kfree_pages(mem, MEGAPGORDER);
+                    goto err;
+                }
+            } else {
+                if (mappages(new, i, MEGAPGSIZE, pa, flags) != 0)
+                    goto err;
+                krefinc((void*)pa);
+            }
+            continue;
+        }
+
+        // 可写页改为写时复制页
+        if (cow && (*pte & PTE_W)) {
+            *pte = (*pte & ~PTE_W) | PTE_COW;
+            downgraded = true;
+        }
 
         // 获取物理地址和权限位
         uint64 pa = PTE2PA(*pte);
         uint flags = PTE_FLAGS(*pte);
 
-        // 分配一页新内存
-        char* mem;
-        if ((mem = kalloc()) == 0)
+        // 将同一物理页映射到新页表
+        // va=i, pa=pa, size=PGSIZE, perm=flags
+        if (mappages(new, i, PGSIZE, pa, flags) != 0)
             goto err;
-
-        // 拷贝数据
-        memmove(mem, (char*)pa, PGSIZE);
-
-        // 将新内存映射到新页表
-        // va=i, pa=mem, size=PGSIZE, perm=flags
-        if (mappages(new, i, PGSIZE, (uint64)mem, flags) != 0) {
-            kfree(mem);
-            goto err;
-        }
+        krefinc((void*)pa);
     }
+
+    // 父进程的可写页变为只读, 刷新其TLB项
+    if (downgraded)
+        uvmflush(old, -1);
     return 0;
 
 err:
-    uvmunmap(new, 0, i / PGSIZE, 1);
+    if (downgraded)
+        uvmflush(old, -1);
+    uvmunmap(new, va, (i - va) / PGSIZE, 1);
     return -1;
 }
 
+// 处理对写时复制页va的写入
+// 如果物理页仍被共享, 则复制一份私有页; 否则直接恢复写权限
+// 成功返回0, 不是写时复制页或内存不足返回-1
+int uvmcow(pagetable_t pagetable, uint64 va)
+{
+    if (va >= MAXVA)
+        return -1;
+
+    pte_t* pte = walk(pagetable, va, false);
+    if (pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 || (*pte & PTE_COW) == 0)
+        return -1;
+
+    uint64 pa = PTE2PA(*pte);
+    uint flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+
+    // 已是唯一引用, 直接恢复写权限
+    if (krefcnt((void*)pa) == 1) {
+        *pte = PA2PTE(pa) | flags;
+        uvmflush(pagetable, va);
+        return 0;
+    }
+
+    // 复制一份私有页
+    char* mem = kalloc();
+    if (mem == 0)
+        return -1;
+    memmove(mem, (char*)pa, PGSIZE);
+    *pte = PA2PTE(mem) | flags;
+    uvmflush(pagetable, va);
+
+    kfree((void*)pa); // 减少原物理页的引用
+    return 0;
+}
+
+// 处理页错误, mm非空时pagetable是当前地址空间的页表 (持有mm->lock)
+static int dofault(struct proc* p, struct mm* mm, pagetable_t pagetable, uint64 va, int write, int maysleep)
+{
+    // 保护页不允许任何访问
+    pte_t* pte = walk(pagetable, va, false);
+    if (pte != 0 && (*pte & PTE_GUARD))
+        return -1;
+
+    // 已映射的写时复制页
+    if (pte != 0 && (*pte & PTE_V) && write && (*pte & PTE_COW))
+        return uvmcow(pagetable, va);
+
+    // 页表项已经允许此次访问, 页错误来自过时的TLB项
+    if (pte != 0 && (*pte & PTE_V) && (*pte & PTE_U) && (*pte & (write ? PTE_W : PTE_R))) {
+        uvmflush(pagetable, va);
+        return 0;
+    }
+
+    if (mm == 0)
+        return -1;
+
+    // 堆空间之外的地址, 交给内存映射处理
+    if (va >= mm->sz)
+        return mmapfault(p, va, write, maysleep);
+
+    // sbrk只增加了mm->sz, 首次访问时才分配物理页
+    if (pte != 0 && (*pte & PTE_V))
+        return -1;
+
+    char* mem = kalloc_zeroed();
+    if (mem == 0)
+        return -1;
+
+    // va=va, pa=mem, size=PGSIZE, perm=可读可写 (用户权限)
+    if (mappages(pagetable, va, PGSIZE, (uint64)mem, PTE_R | PTE_W | PTE_U) != 0) {
+        kfree(mem);
+        return -1;
+    }
+    uvmflush(pagetable, va); // TLB可能缓存了无效的页表项
+    return 0;
+}
+
+// 处理用户页错误 (usertrap以及copyin/copyout)
+// 写时复制页: 复制出私有页
+// 堆空间 (va < mm->sz): 为未映射的页分配一页清零内存
+// 堆空间之上: 交给mmapfault处理内存映射区域
+// 当前地址空间的页错误持有mm->lock处理, 同一地址空间的线程不会同时修改页表
+// maysleep: 调用者没有持有任何锁, 可以休眠从文件读入映射页 (usertrap, mmapprefault)
+//   copyin/copyout可能在持有inode锁, 缓冲区锁或自旋锁时调用, 传入false, 尚未读入的文件映射页直接失败
+// 成功返回0, 非法访问或内存不足返回-1
+int vmfault(pagetable_t pagetable, uint64 va, int write, int maysleep)
+{
+    struct proc* p = myproc();
+
+    if (va >= MAXVA)
+        return -1;
+    va = PGROUNDDOWN(va);
+
+    struct mm* mm = (p != 0 && pagetable == p->pagetable) ? p->mm : 0;
+    if (mm)
+        acquire(&mm->lock);
+    int r = dofault(p, mm, pagetable, va, write, maysleep);
+    if (mm)
+        release(&mm->lock);
+    if (p != 0 && r == 0)
+        p->acct.nfault++;
+    return r;
+}
+
 // 用于标记用户访问无效的PTE
 // 用于exec创建用户栈的保护页
+// 同时清除R|W|X, 内核通过用户窗口访问时也会产生页错误, 而vmfault拒绝保护页
+// 物理页仍然映射, 由uvmunmap随用户内存一起释放
 void uvmclear(pagetable_t pagetable, uint64 va)
 {
     pte_t* pte;
@@ -373,13 +915,17 @@ void uvmclear(pagetable_t pagetable, uint64 va)
     pte = walk(pagetable, va, false);
     if (pte == 0)
         panic("uvmclear");
-    *pte &= ~PTE_U;
+    *pte = (*pte & ~(PTE_U | PTE_R | PTE_W | PTE_X)) | PTE_GUARD;
 }
 
 // 从内核空间 复制数据到 用户空间
 // 从 src 复制 len 字节到给定页表中的虚拟地址 dstva
 int copyout(pagetable_t pagetable, uint64 dstva, char* src, uint64 len)
 {
+    // 当前进程的页表, 直接通过用户窗口拷贝, 由MMU完成地址转换
+    if (uwin(pagetable, dstva, len))
+        return ucopy((void*)(UWINBASE + dstva), src, len);
+
     while (len > 0) {
         // 获取dstva所在页的首地址
         uint64 va0 = PGROUNDDOWN(dstva);
@@ -387,12 +933,18 @@ int copyout(pagetable_t pagetable, uint64 dstva, char* src, uint64 len)
             return -1;
 
         // 获取dstva对应的页表项
+        // 尚未分配的堆页或写时复制页, 先交给vmfault处理
         pte_t* pte = walk(pagetable, va0, false);
-        if (pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 || (*pte & PTE_W) == 0)
+        if (pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_W) == 0) {
+            if (vmfault(pagetable, va0, true, false) < 0)
+                return -1;
+            pte = walk(pagetable, va0, false);
+        }
+        if ((*pte & PTE_U) == 0)
             return -1;
 
-        // 获取va0对应的物理地址
-        uint64 pa0 = PTE2PA(*pte);
+        // 获取va0对应的物理地址 (可能位于大页中)
+        uint64 pa0 = walkaddr(pagetable, va0);
 
         // 计算dstva到页末的字节数
         uint64 n = PGSIZE - (dstva - va0);
@@ -413,10 +965,17 @@ int copyout(pagetable_t pagetable, uint64 dstva, char* src, uint64 len)
 // 从给定页表中的虚拟地址 srcva 复制 len 字节到 dst
 int copyin(pagetable_t pagetable, char* dst, uint64 srcva, uint64 len)
 {
+    // 当前进程的页表, 直接通过用户窗口拷贝, 由MMU完成地址转换
+    if (uwin(pagetable, srcva, len))
+        return ucopy(dst, (void*)(UWINBASE + srcva), len);
+
     while (len > 0) {
         uint64 va0 = PGROUNDDOWN(srcva);       // srcva所在页的首地址
         uint64 pa0 = walkaddr(pagetable, va0); // 获取va0对应的物理地址
 
+        // 尚未分配的堆页, 先分配再读取
+        if (pa0 == 0 && vmfault(pagetable, va0, false, false) == 0)
+            pa0 = walkaddr(pagetable, va0);
         if (pa0 == 0)
             return -1;
 
@@ -445,9 +1004,19 @@ int copyinstr(pagetable_t pagetable, char* dst, uint64 srcva, uint64 max)
     uint64 n, va0, pa0;
     int got_null = 0;
 
+    // 当前进程的页表, 直接通过用户窗口拷贝, 不超过用户窗口的上限
+    if (uwin(pagetable, srcva, 0)) {
+        n = max;
+        if (srcva + n < srcva || srcva + n > MMAPTOP)
+            n = MMAPTOP - srcva;
+        return ucopystr(dst, (char*)(UWINBASE + srcva), n);
+    }
+
     while (got_null == 0 && max > 0) {
         va0 = PGROUNDDOWN(srcva);
         pa0 = walkaddr(pagetable, va0);
+        if (pa0 == 0 && vmfault(pagetable, va0, false, false) == 0)
+            pa0 = walkaddr(pagetable, va0);
         if (pa0 == 0)
             return -1;
         n = PGSIZE - (srcva - va0);
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+# Symbolize samples printed by user/prof.c into a flat profile and
+# folded stacks for flame graphs (flamegraph.pl or speedscope).
+#
+#   make qemu | tee console.log
+#   $ prof usertests -q
+#   python3 prof.py console.log -o prof.folded
+#
+# Kernel addresses are looked up in kernel/kernel.sym. User addresses
+# are looked up in user/<name>.sym, where <name> is the process name
+# recorded with each sample. Kernel frames get a "_[k]" suffix in the
+# folded output so flame graphs color them separately.
+
+import argparse
+import bisect
+import collections
+import os
+import sys
+
+
+class Symtab:
+    """Address to function name lookup built from an objdump -t listing
+    as produced by the Makefile (one "address name" pair per line)."""
+
+    def __init__(self, path):
+        syms = []
+        with open(path) as f:
+            for line in f:
+                parts = line.split()
+                if len(parts) != 2:
+                    continue
+                addr, name = parts
+                if name.startswith((".", "$")) or name.endswith((".c", ".o", ".S")):
+                    continue
+                syms.append((int(addr, 16), name))
+        syms.sort()
+        self.addrs = [a for a, _ in syms]
+        self.names = [n for _, n in syms]
+
+    def lookup(self, addr):
+        i = bisect.bisect_right(self.addrs, addr) - 1
+        if i < 0:
+            return "0x%x" % addr
+        return self.names[i]
+
+
+def parse(path):
+    """Yield (cpu, pid, name, mode, pc, [return addresses]) for every
+    "@prof" line; other console output is ignored."""
+    with open(path, errors="replace") as f:
+        for line in f:
+            i = line.find("@prof ")
+            if i < 0:
+                continue
+            parts = line[i:].split()
+            if len(parts) < 6:
+                continue
+            try:
+                cpu, pid = int(parts[1]), int(parts[2])
+                pcs = [int(x, 16) for x in parts[5:]]
+            except ValueError:
+                continue
+            yield cpu, pid, parts[3], parts[4], pcs[0], pcs[1:]
+
+
+def main():
+    ap = argparse.ArgumentParser(description="symbolize xv6 /dev/prof samples")
+    ap.add_argument("log", help="console output containing @prof lines")
+    ap.add_argument("-o", "--folded", help="write folded stacks to this file")
+    ap.add_argument("-n", "--top", type=int, default=30, help="functions in the flat profile")
+    ap.add_argument("--root", default=os.path.dirname(os.path.abspath(__file__)), help="xv6 source tree")
+    args = ap.parse_args()
+
+    kernel = Symtab(os.path.join(args.root, "kernel", "kernel.sym"))
+    users = {}
+
+    def usersyms(name):
+        if name not in users:
+            path = os.path.join(args.root, "user", name + ".sym")
+            users[name] = Symtab(path) if os.path.exists(path) else None
+        return users[name]
+
+    flat = collections.Counter()
+    folded = collections.Counter()
+    modes = collections.Counter()
+    total = 0
+
+    for cpu, pid, name, mode, pc, stack in parse(args.log):
+        total += 1
+        proc = name if pid != 0 else "[scheduler]"
+        if mode == "k":
+            modes["kernel"] += 1
+            leaf = kernel.lookup(pc)
+            flat[leaf + " [k]"] += 1
+            # return addresses point after the call; look up ra-1 so a
+            # call at the end of a function stays in that function.
+            frames = [kernel.lookup(ra - 1) for ra in reversed(stack)] + [leaf]
+            folded[";".join([proc] + [f + "_[k]" for f in frames])] += 1
+        else:
+            modes["user"] += 1
+            syms = usersyms(name)
+            leaf = syms.lookup(pc) if syms else "0x%x" % pc
+            flat["%s`%s" % (name, leaf)] += 1
+            folded["%s;%s" % (proc, leaf)] += 1
+
+    if total == 0:
+        sys.exit("prof.py: no @prof samples in %s" % args.log)
+
+    print("%d samples: %d user, %d kernel" % (total, modes["user"], modes["kernel"]))
+    print()
+    print("%7s %6s  %s" % ("samples", "%", "function"))
+    for func, n in flat.most_common(args.top):
+        print("%7d %5.1f%%  %s" % (n, 100.0 * n / total, func))
+
+    if args.folded:
+        with open(args.folded, "w") as f:
+            for stack, n in sorted(folded.items()):
+                f.write("%s %d\n" % (stack, n))
+        print()
+        print("folded stacks written to %s" % args.folded)
+
+
+if __name__ == "__main__":
+    main()
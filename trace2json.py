@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+# Convert events printed by user/trace.c into Chrome trace JSON, for
+# chrome://tracing or https://ui.perfetto.dev.
+#
+#   make qemu | tee console.log
+#   $ trace usertests -q bigwrite
+#   python3 trace2json.py console.log -o trace.json
+#
+# Each xv6 process gets a thread in the "processes" track with its
+# system calls, log operations and commits as nested slices, and its
+# sleeps, wakeups and buffer cache accesses as instant events. Each CPU
+# gets a thread in the "cpus" track showing which process ran when.
+# Disk requests are async slices in the "disk" track, keyed by block.
+#
+# Event numbers and system call names are read from kernel/trace.h and
+# kernel/syscall.h, and the time base from kernel/param.h.
+
+import argparse
+import json
+import os
+import re
+import sys
+
+PROCS, CPUS, DISK = 1, 2, 3
+
+STATES = ["unused", "used", "sleeping", "runnable", "running", "zombie"]
+
+
+def defines(path, prefix):
+    """Return {name: value} for "#define <prefix>NAME value" lines."""
+    out = {}
+    with open(path) as f:
+        for line in f:
+            m = re.match(r"#define\s+%s(\w+)\s+(0x[0-9a-fA-F]+|\d+)" % prefix, line)
+            if m:
+                out[m.group(1)] = int(m.group(2), 0)
+    return out
+
+
+def parse(path):
+    """Yield (cpu, pid, event, ts, arg0, arg1) for every "@trace" line;
+    other console output is ignored."""
+    with open(path, errors="replace") as f:
+        for line in f:
+            i = line.find("@trace ")
+            if i < 0:
+                continue
+            parts = line[i:].split()
+            if len(parts) != 7:
+                continue
+            try:
+                cpu, pid = int(parts[1]), int(parts[2])
+                ev, ts, a0, a1 = (int(x, 16) for x in parts[3:])
+            except ValueError:
+                continue
+            yield cpu, pid, ev, ts, a0, a1
+
+
+def signed(x):
+    return x - (1 << 64) if x >= 1 << 63 else x
+
+
+def main():
+    ap = argparse.ArgumentParser(description="convert xv6 /dev/trace events to Chrome trace JSON")
+    ap.add_argument("log", help="console output containing @trace lines")
+    ap.add_argument("-o", "--output", default="trace.json", help="JSON file to write")
+    ap.add_argument("--root", default=os.path.dirname(os.path.abspath(__file__)), help="xv6 source tree")
+    args = ap.parse_args()
+
+    tr = defines(os.path.join(args.root, "kernel", "trace.h"), "TR_")
+    syscalls = {v: k for k, v in defines(os.path.join(args.root, "kernel", "syscall.h"), "SYS_").items()}
+    timebase = defines(os.path.join(args.root, "kernel", "param.h"), "").get("TIMEBASE", 10000000)
+
+    recs = sorted(parse(args.log), key=lambda r: r[3])
+    if not recs:
+        sys.exit("trace2json.py: no @trace events in %s" % args.log)
+    t0 = recs[0][3]
+
+    def us(ts):
+        return (ts - t0) * 1e6 / timebase
+
+    out = []
+    stacks = {}   # pid -> names of open slices, innermost last
+    running = {}  # cpu -> (pid, start ts) of the process on it
+    disk = {}     # blockno -> "read" or "write" of the request in flight
+    pids, cpus = set(), set()
+
+    def begin(pid, ts, name, cat, argv=None):
+        stacks.setdefault(pid, []).append(name)
+        e = {"ph": "B", "name": name, "cat": cat, "pid": PROCS, "tid": pid, "ts": us(ts)}
+        if argv:
+            e["args"] = argv
+        out.append(e)
+
+    # close the innermost slice called name and anything opened inside
+    # it; ends with no matching begin (tracing started mid-call) are dropped.
+    def end(pid, ts, name, argv=None):
+        stack = stacks.get(pid, [])
+        if name not in stack:
+            return
+        while stack:
+            top = stack.pop()
+            e = {"ph": "E", "pid": PROCS, "tid": pid, "ts": us(ts)}
+            if top == name:
+                if argv:
+                    e["args"] = argv
+                out.append(e)
+                return
+            out.append(e)
+
+    def instant(cpu, pid, ts, name, cat, argv):
+        if pid != 0:
+            where = {"pid": PROCS, "tid": pid}
+        else:
+            where = {"pid": CPUS, "tid": cpu}
+        out.append(dict(where, ph="i", s="t", name=name, cat=cat, ts=us(ts), args=argv))
+
+    for cpu, pid, ev, ts, a0, a1 in recs:
+        cpus.add(cpu)
+        if pid != 0:
+            pids.add(pid)
+
+        if ev == tr["SYSCALL_ENTER"]:
+            begin(pid, ts, syscalls.get(a0, "sys%d" % a0), "syscall")
+        elif ev == tr["SYSCALL_EXIT"]:
+            end(pid, ts, syscalls.get(a0, "sys%d" % a0), {"ret": signed(a1)})
+        elif ev == tr["BEGIN_OP"]:
+            begin(pid, ts, "op", "log", {"outstanding": a0})
+        elif ev == tr["END_OP"]:
+            end(pid, ts, "op")
+        elif ev == tr["COMMIT_START"]:
+            begin(pid, ts, "commit", "log", {"blocks": a0})
+        elif ev == tr["COMMIT_END"]:
+            end(pid, ts, "commit")
+        elif ev == tr["SWITCH_IN"]:
+            running[cpu] = (a0, ts)
+        elif ev == tr["SWITCH_OUT"]:
+            p, start = running.pop(cpu, (a0, t0))
+            state = STATES[a1] if a1 < len(STATES) else str(a1)
+            out.append({"ph": "X", "name": "pid %d" % p, "cat": "sched", "pid": CPUS, "tid": cpu,
+                        "ts": us(start), "dur": us(ts) - us(start), "args": {"state": state}})
+        elif ev == tr["SLEEP"]:
+            instant(cpu, pid, ts, "sleep", "sleep", {"chan": "0x%x" % a0})
+        elif ev == tr["WAKEUP"]:
+            instant(cpu, pid, ts, "wakeup", "sleep", {"chan": "0x%x" % a0, "woken": a1})
+        elif ev == tr["BREAD"]:
+            instant(cpu, pid, ts, "bread", "bio", {"block": a0, "hit": bool(a1)})
+        elif ev == tr["BWRITE"]:
+            instant(cpu, pid, ts, "bwrite", "bio", {"block": a0})
+        elif ev == tr["DISK_SUBMIT"]:
+            disk[a0] = "write" if a1 else "read"
+            out.append({"ph": "b", "name": disk[a0], "cat": "disk", "id": a0, "pid": DISK, "tid": 0,
+                        "ts": us(ts), "args": {"block": a0, "pid": pid}})
+        elif ev == tr["DISK_DONE"]:
+            if a0 in disk:
+                out.append({"ph": "e", "name": disk.pop(a0), "cat": "disk", "id": a0, "pid": DISK,
+                            "tid": 0, "ts": us(ts)})
+
+    # slices still open at the end (exit never returns, or tracing
+    # stopped first) are closed at the last event.
+    last = recs[-1][3]
+    for pid, stack in stacks.items():
+        for _ in stack:
+            out.append({"ph": "E", "pid": PROCS, "tid": pid, "ts": us(last)})
+    for cpu, (p, start) in running.items():
+        out.append({"ph": "X", "name": "pid %d" % p, "cat": "sched", "pid": CPUS, "tid": cpu,
+                    "ts": us(start), "dur": us(last) - us(start)})
+
+    meta = [
+        {"ph": "M", "name": "process_name", "pid": PROCS, "args": {"name": "processes"}},
+        {"ph": "M", "name": "process_name", "pid": CPUS, "args": {"name": "cpus"}},
+        {"ph": "M", "name": "process_name", "pid": DISK, "args": {"name": "disk"}},
+    ]
+    meta += [{"ph": "M", "name": "thread_name", "pid": PROCS, "tid": p, "args": {"name": "pid %d" % p}}
+             for p in sorted(pids)]
+    meta += [{"ph": "M", "name": "thread_name", "pid": CPUS, "tid": c, "args": {"name": "cpu%d" % c}}
+             for c in sorted(cpus)]
+
+    with open(args.output, "w") as f:
+        json.dump({"traceEvents": meta + out, "displayTimeUnit": "ns"}, f)
+    print("%d events over %.3f ms written to %s" % (len(recs), us(last) / 1000, args.output))
+
+
+if __name__ == "__main__":
+    main()
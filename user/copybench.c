@@ -0,0 +1,100 @@
+// Measure system call throughput for calls dominated by
+// copyin()/copyout(). Compare a normal kernel, which copies through
+// the user window, against one built with "make SWCOPY=1", which
+// walks the page table in software for every page.
+//
+// usage: copybench [ticks]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+
+#define FILESZ (16 * 1024) // small enough to stay in the buffer cache
+
+static char buf[FILESZ];
+static int duration = 20;
+
+// run op() repeatedly for duration ticks, return the number of calls.
+static int run(char* name, int (*op)(void), int bytes)
+{
+    int n = 0;
+    int start = uptime();
+    while (uptime() - start < duration) {
+        for (int i = 0; i < 64; i++) {
+            if (op() < 0) {
+                printf("copybench: %s failed\n", name);
+                exit(1);
+            }
+        }
+        n += 64;
+    }
+    if (bytes > 0)
+        printf("%s: %d calls/tick, %d KB/tick\n", name, n / duration, n / duration * bytes / 1024);
+    else
+        printf("%s: %d calls/tick\n", name, n / duration);
+    return n;
+}
+
+// copyout of a small struct.
+static int op_fstat(void)
+{
+    struct stat st;
+    return fstat(0, &st);
+}
+
+// copyinstr of a path.
+static int op_open(void)
+{
+    int fd = open("copybench.tmp", O_RDONLY);
+    if (fd >= 0)
+        close(fd);
+    return fd;
+}
+
+// copyin then copyout through a pipe.
+static int pfds[2];
+static int op_pipe(void)
+{
+    if (write(pfds[1], buf, 512) != 512)
+        return -1;
+    return read(pfds[0], buf, 512) == 512 ? 0 : -1;
+}
+
+// copyout of a whole cached file.
+static int op_read(void)
+{
+    int fd = open("copybench.tmp", O_RDONLY);
+    if (fd < 0)
+        return -1;
+    int n = read(fd, buf, FILESZ);
+    close(fd);
+    return n == FILESZ ? 0 : -1;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1)
+        duration = atoi(argv[1]);
+    if (duration <= 0)
+        duration = 1;
+
+    int fd = open("copybench.tmp", O_CREATE | O_WRONLY | O_TRUNC);
+    if (fd < 0 || write(fd, buf, FILESZ) != FILESZ) {
+        printf("copybench: cannot create copybench.tmp\n");
+        exit(1);
+    }
+    close(fd);
+    if (pipe(pfds) < 0) {
+        printf("copybench: pipe failed\n");
+        exit(1);
+    }
+
+    run("fstat", op_fstat, 0);
+    run("open", op_open, 0);
+    run("pipe 512B", op_pipe, 512);
+    run("read 16KB", op_read, FILESZ);
+
+    unlink("copybench.tmp");
+    exit(0);
+}
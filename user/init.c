@@ -23,6 +23,16 @@ int main(void)
     dup(0); // stdout
     dup(0); // stderr
 
+    // 采样分析器设备 (kernel/prof.c)
+    struct stat st;
+    if (stat("/dev/prof", &st) < 0) {
+        mkdir("/dev");
+        mknod("/dev/prof", PROF, 0);
+    }
+    // 内核事件跟踪设备 (kernel/trace.c)
+    if (stat("/dev/trace", &st) < 0)
+        mknod("/dev/trace", TRACE, 0);
+
     for (;;) {
         printf("init: starting sh\n");
 
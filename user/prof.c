@@ -0,0 +1,111 @@
+// Profile a command with the kernel's sampling profiler. Samples are
+// collected from /dev/prof while the command runs and printed to the
+// console afterwards, one "@prof" line per sample. Capture the console
+// output on the host and run prof.py on it to get a flat profile and
+// folded stacks for flame graphs:
+//
+//   make qemu | tee console.log
+//   $ prof -f 1000 usertests -q
+//   python3 prof.py console.log
+//
+// usage: prof [-f hz] command [args...]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+#define MAXSAMPLE 32768 // samples kept in memory; the rest are counted as lost
+
+static struct profsample* samples;
+static int nsample, nlost;
+
+// move everything the kernel has buffered into samples[].
+static void drain(int fd)
+{
+    static struct profsample buf[32];
+    int n;
+    while ((n = read(fd, (char*)buf, sizeof(buf))) > 0) {
+        for (int i = 0; i < n / sizeof(buf[0]); i++) {
+            if (nsample < MAXSAMPLE)
+                samples[nsample++] = buf[i];
+            else
+                nlost++;
+        }
+    }
+}
+
+static int setrate(int fd, int hz)
+{
+    char buf[16];
+    int n = 0;
+    char tmp[16];
+    do {
+        tmp[n++] = '0' + hz % 10;
+        hz /= 10;
+    } while (hz > 0);
+    for (int i = 0; i < n; i++)
+        buf[i] = tmp[n - 1 - i];
+    return write(fd, buf, n) == n ? 0 : -1;
+}
+
+int main(int argc, char* argv[])
+{
+    int hz = 1000;
+    int argi = 1;
+    if (argc > 2 && strcmp(argv[1], "-f") == 0) {
+        hz = atoi(argv[2]);
+        argi = 3;
+    }
+    if (argi >= argc || hz <= 0 || hz > PROFMAXHZ) {
+        fprintf(2, "usage: prof [-f hz] command [args...]\n");
+        exit(1);
+    }
+
+    int fd = open("/dev/prof", O_RDWR);
+    if (fd < 0) {
+        fprintf(2, "prof: cannot open /dev/prof\n");
+        exit(1);
+    }
+    if ((samples = malloc(MAXSAMPLE * sizeof(samples[0]))) == 0) {
+        fprintf(2, "prof: out of memory\n");
+        exit(1);
+    }
+    if (setrate(fd, hz) < 0) {
+        fprintf(2, "prof: cannot start sampling\n");
+        exit(1);
+    }
+
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(2, "prof: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(fd);
+        exec(argv[argi], argv + argi);
+        fprintf(2, "prof: exec %s failed\n", argv[argi]);
+        exit(1);
+    }
+
+    // drain the per-CPU rings every tick so they do not overflow.
+    int xstatus;
+    while (waitpid(pid, &xstatus, WNOHANG) == 0) {
+        drain(fd);
+        sleep(1);
+    }
+    setrate(fd, 0);
+    drain(fd);
+    close(fd);
+
+    for (int i = 0; i < nsample; i++) {
+        struct profsample* s = &samples[i];
+        printf("@prof %d %d %s %s %lx", s->cpu, s->pid, s->name, s->mode == PROF_KERNEL ? "k" : "u", s->pc);
+        for (int d = 0; d < s->depth; d++)
+            printf(" %lx", s->stack[d]);
+        printf("\n");
+    }
+    fprintf(2, "prof: %d samples, %d lost\n", nsample, nlost);
+    exit(xstatus);
+}
@@ -0,0 +1,108 @@
+// Measure path lookup throughput with several processes running at
+// once. Each process stat()s, or open()s and close()s, the same file
+// two directories deep, so almost every inode and block lookup hits in
+// the cache. Run on a multi-core kernel (make CPUS=8 qemu) and compare
+// the aggregate rate as nproc grows; Ctrl+P shows lock contention.
+//
+// usage: statbench [nproc [ticks]]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+
+#define PATH "statbench.d/sub/file"
+
+static int nproc = 8;
+static int duration = 20;
+
+static int op_stat(void)
+{
+    struct stat st;
+    return stat(PATH, &st);
+}
+
+static int op_open(void)
+{
+    int fd = open(PATH, O_RDONLY);
+    if (fd >= 0)
+        close(fd);
+    return fd;
+}
+
+// run op() in nproc processes for duration ticks, starting together,
+// and print the combined number of calls per tick.
+static void run(char* name, int (*op)(void))
+{
+    int fds[2];
+    if (pipe(fds) < 0) {
+        printf("statbench: pipe failed\n");
+        exit(1);
+    }
+
+    // every child counts over the same window of ticks.
+    int start = uptime() + 2;
+    for (int i = 0; i < nproc; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("statbench: fork failed\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            while (uptime() < start)
+                ;
+            int n = 0;
+            while (uptime() - start < duration) {
+                for (int j = 0; j < 16; j++) {
+                    if (op() < 0) {
+                        printf("statbench: %s failed\n", name);
+                        exit(1);
+                    }
+                }
+                n += 16;
+            }
+            write(fds[1], (char*)&n, sizeof(n));
+            exit(0);
+        }
+    }
+    close(fds[1]);
+
+    int total = 0, n;
+    while (read(fds[0], &n, sizeof(n)) == sizeof(n))
+        total += n;
+    close(fds[0]);
+    for (int i = 0; i < nproc; i++)
+        wait(0);
+
+    printf("%s x%d: %d calls/tick\n", name, nproc, total / duration);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1)
+        nproc = atoi(argv[1]);
+    if (argc > 2)
+        duration = atoi(argv[2]);
+    if (nproc <= 0)
+        nproc = 1;
+    if (duration <= 0)
+        duration = 1;
+
+    mkdir("statbench.d");
+    mkdir("statbench.d/sub");
+    int fd = open(PATH, O_CREATE | O_WRONLY);
+    if (fd < 0) {
+        printf("statbench: cannot create %s\n", PATH);
+        exit(1);
+    }
+    close(fd);
+
+    run("stat", op_stat);
+    run("open", op_open);
+
+    unlink(PATH);
+    unlink("statbench.d/sub");
+    unlink("statbench.d");
+    exit(0);
+}
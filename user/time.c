@@ -0,0 +1,69 @@
+// Run a command and report its elapsed, user and system time, along
+// with the context switches, system calls and page faults it caused.
+//
+// usage: time command [args...]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/time.h"
+#include "user/user.h"
+
+// print a duration as seconds with millisecond precision.
+static void prtime(char* label, uint64 ns)
+{
+    uint64 ms = ns / 1000000;
+    uint64 frac = ms % 1000;
+    fprintf(2, "%s %lu.", label, ms / 1000);
+    if (frac < 100)
+        fprintf(2, "0");
+    if (frac < 10)
+        fprintf(2, "0");
+    fprintf(2, "%lus", frac);
+}
+
+static uint64 ts2ns(struct timespec* ts) { return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec; }
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        fprintf(2, "usage: time command [args...]\n");
+        exit(1);
+    }
+
+    // children reaped earlier are already in RUSAGE_CHILDREN.
+    struct rusage before, after;
+    struct timespec start, end;
+    if (getrusage(RUSAGE_CHILDREN, &before) < 0 || clock_gettime(CLOCK_MONOTONIC, &start) < 0) {
+        fprintf(2, "time: getrusage failed\n");
+        exit(1);
+    }
+
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(2, "time: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        exec(argv[1], argv + 1);
+        fprintf(2, "time: exec %s failed\n", argv[1]);
+        exit(1);
+    }
+
+    int xstatus;
+    if (waitpid(pid, &xstatus, 0) != pid) {
+        fprintf(2, "time: waitpid failed\n");
+        exit(1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_CHILDREN, &after);
+
+    prtime("real", ts2ns(&end) - ts2ns(&start));
+    prtime(" user", ts2ns(&after.ru_utime) - ts2ns(&before.ru_utime));
+    prtime(" sys", ts2ns(&after.ru_stime) - ts2ns(&before.ru_stime));
+    fprintf(2, "\n");
+    fprintf(2, "csw %lu/%lu syscall %lu fault %lu\n", after.ru_nvcsw - before.ru_nvcsw,
+        after.ru_nivcsw - before.ru_nivcsw, after.ru_nsyscall - before.ru_nsyscall,
+        after.ru_nfault - before.ru_nfault);
+
+    exit(xstatus);
+}
@@ -0,0 +1,112 @@
+// Trace a command with the kernel's event tracepoints. Events are
+// collected from /dev/trace while the command runs and printed to the
+// console afterwards, one "@trace" line per event. Capture the console
+// output on the host and run trace2json.py on it to get a Chrome trace
+// (chrome://tracing or ui.perfetto.dev):
+//
+//   make qemu | tee console.log
+//   $ trace -m 63 usertests -q bigwrite
+//   python3 trace2json.py console.log -o trace.json
+//
+// The mask selects event categories, bit i for category i (see
+// kernel/trace.h); the default traces everything. Tracing is
+// system-wide, so events from other processes show up too.
+//
+// usage: trace [-m mask] command [args...]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+#define MAXREC 65536 // events kept in memory; the rest are counted as lost
+
+static struct tracerec* recs;
+static int nrec, nlost;
+
+// move everything the kernel has buffered into recs[].
+static void drain(int fd)
+{
+    static struct tracerec buf[64];
+    int n;
+    while ((n = read(fd, (char*)buf, sizeof(buf))) > 0) {
+        for (int i = 0; i < n / sizeof(buf[0]); i++) {
+            if (nrec < MAXREC)
+                recs[nrec++] = buf[i];
+            else
+                nlost++;
+        }
+    }
+}
+
+static int setmask(int fd, int mask)
+{
+    char buf[16];
+    int n = 0;
+    char tmp[16];
+    do {
+        tmp[n++] = '0' + mask % 10;
+        mask /= 10;
+    } while (mask > 0);
+    for (int i = 0; i < n; i++)
+        buf[i] = tmp[n - 1 - i];
+    return write(fd, buf, n) == n ? 0 : -1;
+}
+
+int main(int argc, char* argv[])
+{
+    int mask = (1 << NTRACECAT) - 1;
+    int argi = 1;
+    if (argc > 2 && strcmp(argv[1], "-m") == 0) {
+        mask = atoi(argv[2]);
+        argi = 3;
+    }
+    if (argi >= argc || mask <= 0 || mask >= (1 << NTRACECAT)) {
+        fprintf(2, "usage: trace [-m mask] command [args...]\n");
+        exit(1);
+    }
+
+    int fd = open("/dev/trace", O_RDWR);
+    if (fd < 0) {
+        fprintf(2, "trace: cannot open /dev/trace\n");
+        exit(1);
+    }
+    if ((recs = malloc(MAXREC * sizeof(recs[0]))) == 0) {
+        fprintf(2, "trace: out of memory\n");
+        exit(1);
+    }
+    if (setmask(fd, mask) < 0) {
+        fprintf(2, "trace: cannot start tracing\n");
+        exit(1);
+    }
+
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(2, "trace: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(fd);
+        exec(argv[argi], argv + argi);
+        fprintf(2, "trace: exec %s failed\n", argv[argi]);
+        exit(1);
+    }
+
+    // drain the per-CPU rings every tick so they do not overflow.
+    int xstatus;
+    while (waitpid(pid, &xstatus, WNOHANG) == 0) {
+        drain(fd);
+        sleep(1);
+    }
+    setmask(fd, 0);
+    drain(fd);
+    close(fd);
+
+    for (int i = 0; i < nrec; i++) {
+        struct tracerec* r = &recs[i];
+        printf("@trace %d %d %x %lx %lx %lx\n", r->cpu, r->pid, r->event, r->ts, r->arg0, r->arg1);
+    }
+    fprintf(2, "trace: %d events, %d lost\n", nrec, nlost);
+    exit(xstatus);
+}
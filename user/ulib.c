@@ -137,3 +137,154 @@ int memcmp(const void* s1, const void* s2, uint n)
 }
 
 void* memcpy(void* dst, const void* src, uint n) { return memmove(dst, src, n); }
+
+// 将当前进程的nice值增加inc, 返回新的nice值 (与POSIX相同, 失败时也可能返回-1)
+int nice(int inc)
+{
+    int prio = getpriority(0);
+    if (prio < 0)
+        return -1;
+    int n = 20 - prio + inc;
+    if (n < -20)
+        n = -20;
+    if (n > 19)
+        n = 19;
+    if (setpriority(0, n) < 0)
+        return -1;
+    return n;
+}
+
+// 基于futex的互斥锁
+// state  0:未加锁  1:已加锁且没有等待者  2:已加锁且可能有等待者
+// 无竞争时加锁和解锁都只需一次原子操作, 不进入内核
+void mutex_init(struct mutex* m) { m->state = 0; }
+
+void mutex_lock(struct mutex* m)
+{
+    int c = __sync_val_compare_and_swap(&m->state, 0, 1);
+    if (c == 0)
+        return;
+
+    // 标记有等待者, 然后休眠直到抢到锁
+    if (c != 2)
+        c = __sync_lock_test_and_set(&m->state, 2);
+    while (c != 0) {
+        futex_wait(&m->state, 2);
+        c = __sync_lock_test_and_set(&m->state, 2);
+    }
+}
+
+void mutex_unlock(struct mutex* m)
+{
+    // 可能有等待者, 唤醒其中一个
+    if (__sync_fetch_and_sub(&m->state, 1) != 1) {
+        __sync_lock_release(&m->state);
+        futex_wake(&m->state, 1);
+    }
+}
+
+// 基于futex的条件变量
+// seq在每次signal/broadcast时递增, 等待者在futex_wait中比较seq, 不会丢失在解锁之后的唤醒
+void cond_init(struct cond* c) { c->seq = 0; }
+
+void cond_wait(struct cond* c, struct mutex* m)
+{
+    int seq = c->seq;
+    mutex_unlock(m);
+    futex_wait(&c->seq, seq);
+
+    // 被唤醒时可能还有其他等待者, 按有等待者的方式加锁, 使解锁时会继续唤醒
+    int s = __sync_lock_test_and_set(&m->state, 2);
+    while (s != 0) {
+        futex_wait(&m->state, 2);
+        s = __sync_lock_test_and_set(&m->state, 2);
+    }
+}
+
+void cond_signal(struct cond* c)
+{
+    __sync_fetch_and_add(&c->seq, 1);
+    futex_wake(&c->seq, 1);
+}
+
+void cond_broadcast(struct cond* c)
+{
+    __sync_fetch_and_add(&c->seq, 1);
+    futex_wake(&c->seq, 0x7fffffff); // 全部唤醒
+}
+
+// 线程
+// thread_create为每个线程映射一块用户栈, 栈顶存放入口函数和参数
+// 线程函数返回时调用exit结束线程, 由thread_join回收并移除它的栈
+#define TSTACKSIZE (4 * 4096) // 线程用户栈大小
+#define NTHREAD 64            // 同时存在的线程数上限 (与内核的MAXTHREAD一致)
+
+struct tstart {
+    void (*fn)(void*);
+    void* arg;
+};
+
+static struct {
+    struct mutex lock;
+    int tid[NTHREAD];
+    char* stack[NTHREAD];
+} threads;
+
+static void threadstart(void* a)
+{
+    struct tstart* t = a;
+    t->fn(t->arg);
+    exit(0);
+}
+
+// 创建线程执行fn(arg), 返回tid, 失败返回-1
+int thread_create(void (*fn)(void*), void* arg)
+{
+    char* stack = mmap(0, TSTACKSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (stack == MAP_FAILED)
+        return -1;
+
+    mutex_lock(&threads.lock);
+    int i;
+    for (i = 0; i < NTHREAD && threads.stack[i] != 0; i++)
+        ;
+    if (i == NTHREAD) {
+        mutex_unlock(&threads.lock);
+        munmap(stack, TSTACKSIZE);
+        return -1;
+    }
+
+    // 入口信息放在栈顶, 栈指针在其下方按16字节对齐
+    struct tstart* t = (struct tstart*)(stack + TSTACKSIZE) - 1;
+    t->fn = fn;
+    t->arg = arg;
+    int tid = clone(threadstart, t, (void*)((uint64)t & ~15UL));
+    if (tid < 0) {
+        mutex_unlock(&threads.lock);
+        munmap(stack, TSTACKSIZE);
+        return -1;
+    }
+    threads.tid[i] = tid;
+    threads.stack[i] = stack;
+    mutex_unlock(&threads.lock);
+    return tid;
+}
+
+// 等待线程tid结束, 退出状态写入*status (可以为0), 并移除它的栈
+// 成功返回0, 失败返回-1
+int thread_join(int tid, int* status)
+{
+    if (join(tid, status) < 0)
+        return -1;
+
+    mutex_lock(&threads.lock);
+    for (int i = 0; i < NTHREAD; i++) {
+        if (threads.stack[i] != 0 && threads.tid[i] == tid) {
+            munmap(threads.stack[i], TSTACKSIZE);
+            threads.stack[i] = 0;
+            break;
+        }
+    }
+    mutex_unlock(&threads.lock);
+    return 0;
+}
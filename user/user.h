@@ -1,6 +1,8 @@
 
 
 struct stat;
+struct timespec;
+struct rusage;
 
 // 系统调用接口 (usys.S)
 int fork();
@@ -24,6 +26,18 @@ int unlink(const char* file);
 int link(const char* old, const char* new);
 int mkdir(const char* dir);
 int close(int fd);
+void* mmap(void* addr, uint64 len, int prot, int flags, int fd, uint64 off);
+int munmap(void* addr, uint64 len);
+int setpriority(int pid, int nice);
+int getpriority(int pid); // 返回 20-nice (1~40), 失败返回-1
+int nanosleep(const struct timespec* req, struct timespec* rem);
+int clock_gettime(int clockid, struct timespec* tp);
+int futex_wait(int* addr, int val); // *addr仍等于val时休眠, 被唤醒返回0
+int futex_wake(int* addr, int n);   // 返回唤醒的进程数
+int clone(void (*fn)(void*), void* arg, void* stack); // 创建共享地址空间的线程, 返回tid
+int join(int tid, int* status);                       // 回收同一地址空间的线程tid
+int waitpid(int pid, int* status, int options);       // 等待子进程pid (-1为任意), WNOHANG时不阻塞
+int getrusage(int who, struct rusage* ru);            // RUSAGE_SELF或RUSAGE_CHILDREN
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -39,6 +53,22 @@ void* memset(void*, int, uint);
 int atoi(const char*);
 int memcmp(const void*, const void*, uint);
 void* memcpy(void*, const void*, uint);
+int nice(int inc);
+struct mutex {
+    int state; // 0:未加锁 1:已加锁 2:已加锁且可能有等待者
+};
+struct cond {
+    int seq; // 每次signal/broadcast递增
+};
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+int thread_create(void (*fn)(void*), void* arg);
+int thread_join(int tid, int* status);
 
 // umalloc.c
 void* malloc(uint);
@@ -4,6 +4,9 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/time.h"
+#include "kernel/prof.h"
+#include "kernel/trace.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -767,6 +770,72 @@ void pipe1(char* s)
     }
 }
 
+// several pairs of processes bounce a byte over two pipes, so the
+// reader on one CPU sleeps while the writer on another is about to
+// wake it. a lost wakeup leaves a pair blocked forever; the parent
+// notices that no pair made it in time and fails instead of hanging.
+void pipepingpong(char* s)
+{
+    enum { NPAIR = 4, N = 2000, DEADLINE = 100 };
+    int pids[2 * NPAIR];
+    int np = 0;
+
+    for (int i = 0; i < NPAIR; i++) {
+        int ab[2], ba[2];
+        if (pipe(ab) < 0 || pipe(ba) < 0) {
+            printf("%s: pipe failed\n", s);
+            exit(1);
+        }
+        for (int side = 0; side < 2; side++) {
+            int pid = fork();
+            if (pid < 0) {
+                printf("%s: fork failed\n", s);
+                exit(1);
+            }
+            if (pid == 0) {
+                int in = side ? ab[0] : ba[0];
+                int out = side ? ba[1] : ab[1];
+                char c = 0;
+                for (int n = 0; n < N; n++) {
+                    if (side == 0 && write(out, &c, 1) != 1)
+                        exit(1);
+                    if (read(in, &c, 1) != 1)
+                        exit(1);
+                    if (side == 1 && write(out, &c, 1) != 1)
+                        exit(1);
+                }
+                exit(0);
+            }
+            pids[np++] = pid;
+        }
+        close(ab[0]);
+        close(ab[1]);
+        close(ba[0]);
+        close(ba[1]);
+    }
+
+    int start = uptime();
+    int left = np, xstatus;
+    while (left > 0) {
+        int pid = waitpid(-1, &xstatus, WNOHANG);
+        if (pid > 0) {
+            if (xstatus != 0) {
+                printf("%s: ping-pong process failed\n", s);
+                exit(1);
+            }
+            left--;
+        } else if (uptime() - start > DEADLINE) {
+            for (int i = 0; i < np; i++)
+                kill(pids[i]);
+            while (wait(0) > 0)
+                ;
+            printf("%s: %d ping-pong processes stuck, lost wakeup?\n", s, left);
+            exit(1);
+        } else
+            sleep(1);
+    }
+}
+
 // test if child is killed (status = -1)
 void killstatus(char* s)
 {
@@ -1913,7 +1982,8 @@ void iref(char* s)
 // inside the bigger usertests binary, we run out of memory first.
 void forktest(char* s)
 {
-    enum { N = 1000 };
+    // fork must hit the proc limit (or run out of memory) before N
+    enum { N = NPROC };
     int n, pid;
 
     for (n = 0; n < N; n++) {
@@ -1930,7 +2000,7 @@ void forktest(char* s)
     }
 
     if (n == N) {
-        printf("%s: fork claimed to work 1000 times!\n", s);
+        printf("%s: fork claimed to work %d times!\n", s, N);
         exit(1);
     }
 
@@ -1947,224 +2017,1182 @@ void forktest(char* s)
     }
 }
 
-void sbrkbasic(char* s)
+// test that fork shares memory copy-on-write: a parent holding
+// more than half of physical memory can still fork, and writes
+// in the child are not visible to the parent.
+void cowfork(char* s)
 {
-    enum { TOOMUCH = 1024 * 1024 * 1024 };
-    int i, pid, xstatus;
-    char *c, *a, *b;
-
-    // does sbrk() return the expected failure value?
-    pid = fork();
-    if (pid < 0) {
-        printf("fork failed in sbrkbasic\n");
+    uint64 sz = (PHYSTOP - KERNBASE) / 2;
+    char* a = sbrk(sz);
+    if (a == (char*)0xffffffffffffffffL) {
+        printf("%s: sbrk failed\n", s);
         exit(1);
     }
-    if (pid == 0) {
-        a = sbrk(TOOMUCH);
-        if (a == (char*)0xffffffffffffffffL) {
-            // it's OK if this fails.
+
+    for (uint64 i = 0; i < sz; i += PGSIZE)
+        a[i] = (char)(i / PGSIZE);
+
+    for (int k = 0; k < 3; k++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("%s: fork failed\n", s);
+            exit(1);
+        }
+        if (pid == 0) {
+            for (uint64 i = 0; i < sz; i += 64 * PGSIZE) {
+                if (a[i] != (char)(i / PGSIZE)) {
+                    printf("%s: child read wrong value\n", s);
+                    exit(1);
+                }
+                a[i] = -1;
+            }
             exit(0);
         }
 
-        for (b = a; b < a + TOOMUCH; b += 4096) {
-            *b = 99;
+        int xstatus;
+        wait(&xstatus);
+        if (xstatus != 0)
+            exit(xstatus);
+    }
+
+    for (uint64 i = 0; i < sz; i += PGSIZE) {
+        if (a[i] != (char)(i / PGSIZE)) {
+            printf("%s: parent saw child's write\n", s);
+            exit(1);
         }
+    }
 
-        // we should not get here! either sbrk(TOOMUCH)
-        // should have failed, or (with lazy allocation)
-        // a pagefault should have killed this process.
+    sbrk(-sz);
+}
+
+// sbrk() should only reserve address space; pages are allocated
+// on first touch, so reserving more than physical memory works as
+// long as only a little of it is used.
+void lazysbrk(char* s)
+{
+    enum { BIG = 1024 * 1024 * 1024 };
+    char* a = sbrk(BIG);
+    if (a == (char*)0xffffffffffffffffL) {
+        printf("%s: sbrk of untouched memory failed\n", s);
         exit(1);
     }
 
-    wait(&xstatus);
-    if (xstatus == 1) {
-        printf("%s: too much memory allocated!\n", s);
+    // touch a few scattered pages, leaving holes in between.
+    for (uint64 i = 0; i < BIG; i += 4 * 1024 * 1024)
+        a[i] = (char)(i >> 22);
+
+    // the kernel must fault in pages it writes to or reads from.
+    int fds[2];
+    if (pipe((int*)(a + BIG - PGSIZE)) != 0) {
+        printf("%s: pipe() into untouched page failed\n", s);
         exit(1);
     }
-
-    // can one sbrk() less than a page?
-    a = sbrk(0);
-    for (i = 0; i < 5000; i++) {
-        b = sbrk(1);
-        if (b != a) {
-            printf("%s: sbrk test failed %d %p %p\n", s, i, a, b);
-            exit(1);
-        }
-        *b = 1;
-        a = b + 1;
+    memmove(fds, a + BIG - PGSIZE, sizeof(fds));
+    if (write(fds[1], a + BIG - 2 * PGSIZE, 10) != 10) {
+        printf("%s: write from untouched page failed\n", s);
+        exit(1);
     }
-    pid = fork();
-    if (pid < 0) {
-        printf("%s: sbrk test fork failed\n", s);
+    if (read(fds[0], a + BIG - 3 * PGSIZE, 10) != 10) {
+        printf("%s: read into untouched page failed\n", s);
         exit(1);
     }
-    c = sbrk(1);
-    c = sbrk(1);
-    if (c != a + 1) {
-        printf("%s: sbrk test failed post-fork\n", s);
+    close(fds[0]);
+    close(fds[1]);
+
+    // fork must cope with the holes.
+    int pid = fork();
+    if (pid < 0) {
+        printf("%s: fork failed\n", s);
         exit(1);
     }
-    if (pid == 0)
+    if (pid == 0) {
+        for (uint64 i = 0; i < BIG; i += 4 * 1024 * 1024) {
+            if (a[i] != (char)(i >> 22) || a[i + PGSIZE] != 0) {
+                printf("%s: child read wrong value\n", s);
+                exit(1);
+            }
+        }
         exit(0);
+    }
+    int xstatus;
     wait(&xstatus);
-    exit(xstatus);
+    if (xstatus != 0)
+        exit(xstatus);
+
+    if (sbrk(-BIG) == (char*)0xffffffffffffffffL) {
+        printf("%s: sbrk shrink failed\n", s);
+        exit(1);
+    }
 }
 
-void sbrkmuch(char* s)
+// map a file shared and private, check the contents, and check
+// that only shared writes reach the file.
+void mmapfile(char* s)
 {
-    enum { BIG = 100 * 1024 * 1024 };
-    char *c, *oldbrk, *a, *lastaddr, *p;
-    uint64 amt;
-
-    oldbrk = sbrk(0);
+    enum { FSZ = 2 * PGSIZE + 100 };
+    char* f = "mmapfile";
+    int fd, i;
 
-    // can one grow address space to something big?
-    a = sbrk(0);
-    amt = BIG - (uint64)a;
-    p = sbrk(amt);
-    if (p != a) {
-        printf("%s: sbrk test failed to grow big address space; enough phys mem?\n", s);
+    unlink(f);
+    fd = open(f, O_CREATE | O_RDWR);
+    if (fd < 0) {
+        printf("%s: open failed\n", s);
         exit(1);
     }
+    for (i = 0; i < FSZ; i++) {
+        char c = 'a' + i % 26;
+        if (write(fd, &c, 1) != 1) {
+            printf("%s: write failed\n", s);
+            exit(1);
+        }
+    }
 
-    // touch each page to make sure it exists.
-    char* eee = sbrk(0);
-    for (char* pp = a; pp < eee; pp += 4096)
-        *pp = 1;
-
-    lastaddr = (char*)(BIG - 1);
-    *lastaddr = 99;
-
-    // can one de-allocate?
-    a = sbrk(0);
-    c = sbrk(-PGSIZE);
-    if (c == (char*)0xffffffffffffffffL) {
-        printf("%s: sbrk could not deallocate\n", s);
+    // private mapping: reads see the file, writes stay private.
+    char* p = mmap(0, FSZ, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        printf("%s: mmap private failed\n", s);
         exit(1);
     }
-    c = sbrk(0);
-    if (c != a - PGSIZE) {
-        printf("%s: sbrk deallocation produced wrong address, a %p c %p\n", s, a, c);
+    for (i = 0; i < FSZ; i++) {
+        if (p[i] != 'a' + i % 26) {
+            printf("%s: private mapping has wrong content at %d\n", s, i);
+            exit(1);
+        }
+    }
+    // the tail of the last page, past the end of the file, is zero.
+    if (p[FSZ] != 0 || p[3 * PGSIZE - 1] != 0) {
+        printf("%s: mapping past end of file not zero\n", s);
+        exit(1);
+    }
+    p[0] = 'X';
+    if (munmap(p, FSZ) != 0) {
+        printf("%s: munmap private failed\n", s);
         exit(1);
     }
 
-    // can one re-allocate that page?
-    a = sbrk(0);
-    c = sbrk(PGSIZE);
-    if (c != a || sbrk(0) != a + PGSIZE) {
-        printf("%s: sbrk re-allocation failed, a %p c %p\n", s, a, c);
+    // shared mapping: writes reach the file after munmap.
+    p = mmap(0, FSZ, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        printf("%s: mmap shared failed\n", s);
         exit(1);
     }
-    if (*lastaddr == 99) {
-        // should be zero
-        printf("%s: sbrk de-allocation didn't really deallocate\n", s);
+    if (p[0] != 'a') {
+        printf("%s: private write reached the file\n", s);
         exit(1);
     }
+    p[0] = 'Y';
+    p[PGSIZE + 1] = 'Z';
 
-    a = sbrk(0);
-    c = sbrk(-(sbrk(0) - oldbrk));
-    if (c != a) {
-        printf("%s: sbrk downsize failed, a %p c %p\n", s, a, c);
+    // read() into the mapping of the file being read.
+    char buf[8];
+    close(fd);
+    fd = open(f, O_RDONLY);
+    if (read(fd, p + 2 * PGSIZE, 4) != 4) {
+        printf("%s: read into own mapping failed\n", s);
         exit(1);
     }
-}
+    close(fd);
 
-// can we read the kernel's memory?
-void kernmem(char* s)
-{
-    char* a;
-    int pid;
+    // unmap the first page only, then the rest.
+    if (munmap(p, PGSIZE) != 0 || munmap(p + PGSIZE, 2 * PGSIZE) != 0) {
+        printf("%s: munmap shared failed\n", s);
+        exit(1);
+    }
 
-    for (a = (char*)(KERNBASE); a < (char*)(KERNBASE + 2000000); a += 50000) {
-        pid = fork();
-        if (pid < 0) {
-            printf("%s: fork failed\n", s);
-            exit(1);
-        }
-        if (pid == 0) {
-            printf("%s: oops could read %p = %x\n", s, a, *a);
-            exit(1);
-        }
-        int xstatus;
-        wait(&xstatus);
-        if (xstatus != -1) // did kernel kill child?
-            exit(1);
+    fd = open(f, O_RDONLY);
+    if (read(fd, buf, 2) != 2 || buf[0] != 'Y' || buf[1] != 'b') {
+        printf("%s: shared write did not reach the file\n", s);
+        exit(1);
     }
-}
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.size != FSZ) {
+        printf("%s: file size changed\n", s);
+        exit(1);
+    }
+    close(fd);
 
-// user code should not be able to write to addresses above MAXVA.
-void MAXVAplus(char* s)
-{
-    volatile uint64 a = MAXVA;
-    for (; a != 0; a <<= 1) {
-        int pid;
-        pid = fork();
-        if (pid < 0) {
-            printf("%s: fork failed\n", s);
-            exit(1);
-        }
-        if (pid == 0) {
-            *(char*)a = 99;
-            printf("%s: oops wrote %p\n", s, (void*)a);
-            exit(1);
-        }
-        int xstatus;
-        wait(&xstatus);
-        if (xstatus != -1) // did kernel kill child?
-            exit(1);
+    // mapping a read-only file shared and writable must fail.
+    fd = open(f, O_RDONLY);
+    if (mmap(0, PGSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) != MAP_FAILED) {
+        printf("%s: mmap allowed writes to read-only file\n", s);
+        exit(1);
     }
+    close(fd);
+    unlink(f);
 }
 
-// if we run the system out of memory, does it clean up the last
-// failed allocation?
-void sbrkfail(char* s)
+// shared anonymous memory is shared with a child; private
+// anonymous memory is copied.
+void mmapfork(char* s)
 {
-    enum { BIG = 100 * 1024 * 1024 };
-    int i, xstatus;
-    int fds[2];
-    char scratch;
-    char *c, *a;
-    int pids[10];
-    int pid;
+    int* shared = mmap(0, PGSIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    int* private = mmap(0, PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED || private == MAP_FAILED) {
+        printf("%s: mmap anonymous failed\n", s);
+        exit(1);
+    }
+    *private = 1;
 
-    if (pipe(fds) != 0) {
-        printf("%s: pipe() failed\n", s);
+    int pid = fork();
+    if (pid < 0) {
+        printf("%s: fork failed\n", s);
         exit(1);
     }
-    for (i = 0; i < sizeof(pids) / sizeof(pids[0]); i++) {
-        if ((pids[i] = fork()) == 0) {
-            // allocate a lot of memory
-            sbrk(BIG - (uint64)sbrk(0));
-            write(fds[1], "x", 1);
-            // sit around until killed
-            for (;;)
-                sleep(1000);
-        }
-        if (pids[i] != -1)
-            read(fds[0], &scratch, 1);
+    if (pid == 0) {
+        *shared = 42;
+        *private = 2;
+        exit(0);
     }
+    int xstatus;
+    wait(&xstatus);
+    if (xstatus != 0)
+        exit(xstatus);
 
-    // if those failed allocations freed up the pages they did allocate,
-    // we'll be able to allocate here
-    c = sbrk(PGSIZE);
-    for (i = 0; i < sizeof(pids) / sizeof(pids[0]); i++) {
-        if (pids[i] == -1)
-            continue;
-        kill(pids[i]);
-        wait(0);
-    }
-    if (c == (char*)0xffffffffffffffffL) {
-        printf("%s: failed sbrk leaked memory\n", s);
+    if (*shared != 42 || *private != 1) {
+        printf("%s: shared %d private %d\n", s, *shared, *private);
         exit(1);
     }
 
-    // test running fork with the above allocated page
+    // the unmapped region must fault.
+    munmap(shared, PGSIZE);
     pid = fork();
-    if (pid < 0) {
-        printf("%s: fork failed\n", s);
+    if (pid == 0) {
+        *shared = 1;
+        exit(0);
+    }
+    wait(&xstatus);
+    if (xstatus != -1) {
+        printf("%s: access after munmap did not fault\n", s);
         exit(1);
     }
-    if (pid == 0) {
+}
+
+// anonymous MAP_HUGETLB regions are 2MB aligned, shared huge pages
+// are shared with a child and private ones are copied.
+void hugemmap(char* s)
+{
+    enum { MEGA = 2 * 1024 * 1024 };
+    char* private = mmap(0, MEGA + PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    int* shared = mmap(0, MEGA, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (private == MAP_FAILED || shared == MAP_FAILED) {
+        printf("%s: mmap huge failed\n", s);
+        exit(1);
+    }
+    if ((uint64)private % MEGA != 0 || (uint64)shared % MEGA != 0) {
+        printf("%s: huge mapping not aligned %p %p\n", s, private, shared);
+        exit(1);
+    }
+
+    // the length was rounded up to two huge pages.
+    for (int i = 0; i < 2 * MEGA; i += PGSIZE)
+        private[i] = i / PGSIZE;
+    shared[0] = 1;
+    shared[MEGA / sizeof(int) - 1] = 2;
+
+    int pid = fork();
+    if (pid < 0) {
+        printf("%s: fork failed\n", s);
+        exit(1);
+    }
+    if (pid == 0) {
+        for (int i = 0; i < 2 * MEGA; i += PGSIZE) {
+            if (private[i] != (char)(i / PGSIZE)) {
+                printf("%s: child read %d at %d\n", s, private[i], i);
+                exit(1);
+            }
+        }
+        private[0] = 99;
+        shared[0] = 42;
+        exit(0);
+    }
+    int xstatus;
+    wait(&xstatus);
+    if (xstatus != 0)
+        exit(xstatus);
+    if (private[0] != 0 || shared[0] != 42 || shared[MEGA / sizeof(int) - 1] != 2) {
+        printf("%s: private %d shared %d %d\n", s, private[0], shared[0], shared[MEGA / sizeof(int) - 1]);
+        exit(1);
+    }
+
+    // a huge page can only be unmapped as a whole.
+    if (munmap(private + PGSIZE, PGSIZE) != -1) {
+        printf("%s: partial munmap of a huge page succeeded\n", s);
+        exit(1);
+    }
+    if (munmap(private, MEGA) != 0 || private[MEGA + PGSIZE] != (char)(MEGA / PGSIZE + 1)) {
+        printf("%s: munmap of the first huge page failed\n", s);
+        exit(1);
+    }
+    if (munmap(private + MEGA, MEGA) != 0 || munmap(shared, MEGA) != 0) {
+        printf("%s: munmap huge failed\n", s);
+        exit(1);
+    }
+}
+
+static uint64 nsec(struct timespec* ts) { return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec; }
+
+// nanosleep() wakes a sleeper at its own deadline, with a resolution
+// far below one tick, and clock_gettime(CLOCK_MONOTONIC) never goes back.
+void nanosleeptest(char* s)
+{
+    enum { N = 10, MS = 1000000 };
+    struct timespec t0, t1, req;
+
+    if (clock_gettime(0, &t0) != -1) {
+        printf("%s: clock_gettime accepted an unknown clock\n", s);
+        exit(1);
+    }
+    req.tv_sec = 0;
+    req.tv_nsec = NSEC_PER_SEC;
+    if (nanosleep(&req, 0) != -1) {
+        printf("%s: nanosleep accepted tv_nsec >= 1s\n", s);
+        exit(1);
+    }
+
+    uint64 prev = 0;
+    for (int i = 0; i < 1000; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (nsec(&t0) < prev) {
+            printf("%s: clock went back from %lu to %lu\n", s, prev, nsec(&t0));
+            exit(1);
+        }
+        prev = nsec(&t0);
+    }
+
+    // N sleeps of 1ms each; a tick-based sleep would need at least N ticks.
+    req.tv_nsec = MS;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < N; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        uint64 start = nsec(&t1);
+        if (nanosleep(&req, 0) != 0) {
+            printf("%s: nanosleep failed\n", s);
+            exit(1);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (nsec(&t1) - start < MS) {
+            printf("%s: woke after %lu ns, before the deadline\n", s, nsec(&t1) - start);
+            exit(1);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (nsec(&t1) - nsec(&t0) >= 5UL * MS * N) {
+        printf("%s: %d sleeps of 1ms took %lu ns\n", s, N, nsec(&t1) - nsec(&t0));
+        exit(1);
+    }
+
+    // kill() interrupts a long nanosleep.
+    int pid = fork();
+    if (pid < 0) {
+        printf("%s: fork failed\n", s);
+        exit(1);
+    }
+    if (pid == 0) {
+        req.tv_sec = 100;
+        req.tv_nsec = 0;
+        nanosleep(&req, 0);
+        exit(0);
+    }
+    req.tv_nsec = 10 * MS;
+    nanosleep(&req, 0);
+    kill(pid);
+    int xstatus;
+    wait(&xstatus);
+    if (xstatus != -1) {
+        printf("%s: killed sleeper exited with %d\n", s, xstatus);
+        exit(1);
+    }
+}
+
+// a futex-based mutex and condition variable in a MAP_SHARED page
+// synchronize several processes without spinning.
+void futextest(char* s)
+{
+    enum { NCHILD = 4, N = 2000, ROUNDS = 100 };
+    struct shared {
+        struct mutex m;
+        struct cond c;
+        int counter;
+        int turn;
+    }* sh = mmap(0, PGSIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sh == MAP_FAILED) {
+        printf("%s: mmap failed\n", s);
+        exit(1);
+    }
+    mutex_init(&sh->m);
+    cond_init(&sh->c);
+
+    int x = 1;
+    if (futex_wait(&x, 2) != -1) {
+        printf("%s: futex_wait slept on a changed value\n", s);
+        exit(1);
+    }
+    if (futex_wake(&x, 1) != 0) {
+        printf("%s: futex_wake woke a process without waiters\n", s);
+        exit(1);
+    }
+
+    // non-atomic increments are only safe under the mutex.
+    for (int i = 0; i < NCHILD; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("%s: fork failed\n", s);
+            exit(1);
+        }
+        if (pid == 0) {
+            for (int j = 0; j < N; j++) {
+                mutex_lock(&sh->m);
+                int v = sh->counter;
+                if (j % 64 == 0)
+                    sleep(0);
+                sh->counter = v + 1;
+                mutex_unlock(&sh->m);
+            }
+            exit(0);
+        }
+    }
+    for (int i = 0; i < NCHILD; i++) {
+        int xstatus;
+        wait(&xstatus);
+        if (xstatus != 0)
+            exit(xstatus);
+    }
+    if (sh->counter != NCHILD * N) {
+        printf("%s: counter %d, expected %d\n", s, sh->counter, NCHILD * N);
+        exit(1);
+    }
+
+    // ping-pong between parent (turn 0) and child (turn 1).
+    int pid = fork();
+    if (pid < 0) {
+        printf("%s: fork failed\n", s);
+        exit(1);
+    }
+    int me = pid == 0;
+    for (int i = 0; i < ROUNDS; i++) {
+        mutex_lock(&sh->m);
+        while (sh->turn != me)
+            cond_wait(&sh->c, &sh->m);
+        sh->turn = !me;
+        cond_signal(&sh->c);
+        mutex_unlock(&sh->m);
+    }
+    if (me)
+        exit(0);
+    int xstatus;
+    wait(&xstatus);
+    if (xstatus != 0)
+        exit(xstatus);
+    munmap(sh, PGSIZE);
+}
+
+// a thread sleeps in futex_wait on a private word, then the process
+// forks. fork makes the page copy-on-write again, so the main thread's
+// store moves the word to a new physical page; the futex_wake after it
+// must still find the waiter.
+static int forkfutexword;
+
+static void forkfutexwaiter(void* arg)
+{
+    while (forkfutexword == 0)
+        futex_wait(&forkfutexword, 0);
+    exit(0);
+}
+
+void forkfutex(char* s)
+{
+    enum { DEADLINE = 50 };
+    int pid = fork();
+    if (pid < 0) {
+        printf("%s: fork failed\n", s);
+        exit(1);
+    }
+    if (pid == 0) {
+        int tid = thread_create(forkfutexwaiter, 0);
+        if (tid < 0) {
+            printf("%s: thread_create failed\n", s);
+            exit(1);
+        }
+        sleep(2); // let the thread block in futex_wait
+
+        // the forked child keeps the old page shared until the store
+        // below has copied it.
+        int fds[2];
+        if (pipe(fds) < 0) {
+            printf("%s: pipe failed\n", s);
+            exit(1);
+        }
+        int cpid = fork();
+        if (cpid < 0) {
+            printf("%s: fork failed\n", s);
+            exit(1);
+        }
+        if (cpid == 0) {
+            char c;
+            close(fds[1]);
+            read(fds[0], &c, 1);
+            exit(0);
+        }
+        close(fds[0]);
+
+        forkfutexword = 1;
+        futex_wake(&forkfutexword, 1);
+        close(fds[1]);
+        wait(0);
+
+        int xstatus;
+        if (thread_join(tid, &xstatus) < 0 || xstatus != 0) {
+            printf("%s: waiter thread failed\n", s);
+            exit(1);
+        }
+        exit(0);
+    }
+
+    // a lost wakeup leaves the waiter asleep; fail instead of hanging.
+    int start = uptime(), xstatus;
+    while (waitpid(pid, &xstatus, WNOHANG) == 0) {
+        if (uptime() - start > DEADLINE) {
+            kill(pid);
+            wait(0);
+            printf("%s: futex waiter not woken after fork\n", s);
+            exit(1);
+        }
+        sleep(1);
+    }
+    if (xstatus != 0)
+        exit(1);
+}
+
+// threads created with clone share memory, file descriptors and
+// the heap; sbrk from several threads at once must hand out
+// disjoint ranges, and thread_join reaps each thread.
+static struct mutex threadmu;
+static int threadcount;
+static int threadfd;
+static char* threadbrk[8];
+
+static void threadworker(void* arg)
+{
+    int id = (int)(uint64)arg;
+    for (int i = 0; i < 1000; i++) {
+        mutex_lock(&threadmu);
+        int v = threadcount;
+        if (i % 128 == 0)
+            sleep(0);
+        threadcount = v + 1;
+        mutex_unlock(&threadmu);
+    }
+
+    // the heap grows concurrently; each range must be private.
+    char* p = sbrk(PGSIZE);
+    if (p == (char*)-1)
+        exit(2);
+    memset(p, 'a' + id, PGSIZE);
+    threadbrk[id] = p;
+
+    // a descriptor opened by the main thread is visible here.
+    if (write(threadfd, "x", 1) != 1)
+        exit(3);
+    exit(10 + id);
+}
+
+void threadtest(char* s)
+{
+    enum { NT = 8 };
+    int tids[NT];
+
+    int fds[2];
+    if (pipe(fds) < 0) {
+        printf("%s: pipe failed\n", s);
+        exit(1);
+    }
+    threadfd = fds[1];
+    mutex_init(&threadmu);
+
+    for (int i = 0; i < NT; i++) {
+        if ((tids[i] = thread_create(threadworker, (void*)(uint64)i)) < 0) {
+            printf("%s: thread_create failed\n", s);
+            exit(1);
+        }
+    }
+
+    // threads are reaped by join, not by wait.
+    if (wait(0) != -1) {
+        printf("%s: wait returned a thread\n", s);
+        exit(1);
+    }
+
+    for (int i = 0; i < NT; i++) {
+        int xstatus;
+        if (thread_join(tids[i], &xstatus) < 0) {
+            printf("%s: thread_join failed\n", s);
+            exit(1);
+        }
+        if (xstatus != 10 + i) {
+            printf("%s: thread %d exit status %d\n", s, i, xstatus);
+            exit(1);
+        }
+    }
+    if (thread_join(tids[0], 0) != -1) {
+        printf("%s: joined a thread twice\n", s);
+        exit(1);
+    }
+
+    if (threadcount != NT * 1000) {
+        printf("%s: counter %d, expected %d\n", s, threadcount, NT * 1000);
+        exit(1);
+    }
+    for (int i = 0; i < NT; i++) {
+        for (int j = 0; j < PGSIZE; j++) {
+            if (threadbrk[i][j] != 'a' + i) {
+                printf("%s: sbrk ranges overlap\n", s);
+                exit(1);
+            }
+        }
+    }
+
+    char buf[NT];
+    if (read(fds[0], buf, NT) != NT) {
+        printf("%s: threads did not share the descriptor table\n", s);
+        exit(1);
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// waitpid() reaps a specific child, and WNOHANG returns 0 instead of
+// blocking while children are still running.
+void waitpidtest(char* s)
+{
+    enum { NCHILD = 3 };
+    int pids[NCHILD];
+    int fds[2];
+    if (pipe(fds) < 0) {
+        printf("%s: pipe failed\n", s);
+        exit(1);
+    }
+
+    for (int i = 0; i < NCHILD; i++) {
+        pids[i] = fork();
+        if (pids[i] < 0) {
+            printf("%s: fork failed\n", s);
+            exit(1);
+        }
+        if (pids[i] == 0) {
+            char c;
+            close(fds[1]);
+            if (read(fds[0], &c, 1) != 1)
+                exit(1);
+            exit(20 + i);
+        }
+    }
+    close(fds[0]);
+
+    if (waitpid(-1, 0, WNOHANG) != 0) {
+        printf("%s: WNOHANG did not return 0 with running children\n", s);
+        exit(1);
+    }
+    if (waitpid(pids[1], 0, WNOHANG) != 0) {
+        printf("%s: WNOHANG did not return 0 for a running child\n", s);
+        exit(1);
+    }
+    if (waitpid(getpid(), 0, 0) != -1) {
+        printf("%s: waitpid accepted a pid that is not a child\n", s);
+        exit(1);
+    }
+
+    if (write(fds[1], "xxx", NCHILD) != NCHILD) {
+        printf("%s: write failed\n", s);
+        exit(1);
+    }
+    close(fds[1]);
+
+    // reap in reverse order, whichever child exits first.
+    for (int i = NCHILD - 1; i >= 0; i--) {
+        int xstatus;
+        if (waitpid(pids[i], &xstatus, 0) != pids[i]) {
+            printf("%s: waitpid did not return child %d\n", s, i);
+            exit(1);
+        }
+        if (xstatus != 20 + i) {
+            printf("%s: child %d exit status %d\n", s, i, xstatus);
+            exit(1);
+        }
+    }
+
+    if (waitpid(pids[0], 0, 0) != -1 || waitpid(-1, 0, WNOHANG) != -1) {
+        printf("%s: waitpid found a child that was already reaped\n", s);
+        exit(1);
+    }
+}
+
+// getrusage() counts system calls and page faults, and a reaped
+// child's CPU time shows up in RUSAGE_CHILDREN.
+void rusagetest(char* s)
+{
+    enum { NCALL = 100, NPAGE = 8 };
+    struct rusage r0, r1;
+
+    if (getrusage(RUSAGE_SELF, &r0) < 0) {
+        printf("%s: getrusage failed\n", s);
+        exit(1);
+    }
+    for (int i = 0; i < NCALL; i++)
+        getpid();
+    if (getrusage(RUSAGE_SELF, &r1) < 0) {
+        printf("%s: getrusage failed\n", s);
+        exit(1);
+    }
+    if (r1.ru_nsyscall - r0.ru_nsyscall < NCALL) {
+        printf("%s: counted %lu of %d syscalls\n", s, r1.ru_nsyscall - r0.ru_nsyscall, NCALL);
+        exit(1);
+    }
+    if (getrusage(2, &r1) != -1) {
+        printf("%s: getrusage accepted a bad who\n", s);
+        exit(1);
+    }
+
+    if (getrusage(RUSAGE_CHILDREN, &r0) < 0) {
+        printf("%s: getrusage failed\n", s);
+        exit(1);
+    }
+    int pid = fork();
+    if (pid < 0) {
+        printf("%s: fork failed\n", s);
+        exit(1);
+    }
+    if (pid == 0) {
+        // sbrk pages are allocated on first touch.
+        char* p = sbrk(NPAGE * PGSIZE);
+        if (p == (char*)-1)
+            exit(1);
+        for (int i = 0; i < NPAGE; i++)
+            p[i * PGSIZE] = 1;
+
+        // spin in user mode for a few ticks.
+        int start = uptime();
+        while (uptime() - start < 3)
+            for (volatile int i = 0; i < 100000; i++)
+                ;
+        exit(0);
+    }
+    int xstatus;
+    if (waitpid(pid, &xstatus, 0) != pid || xstatus != 0) {
+        printf("%s: child failed\n", s);
+        exit(1);
+    }
+    if (getrusage(RUSAGE_CHILDREN, &r1) < 0) {
+        printf("%s: getrusage failed\n", s);
+        exit(1);
+    }
+    if (r1.ru_nfault - r0.ru_nfault < NPAGE) {
+        printf("%s: counted %lu of %d child page faults\n", s, r1.ru_nfault - r0.ru_nfault, NPAGE);
+        exit(1);
+    }
+    uint64 ut0 = r0.ru_utime.tv_sec * NSEC_PER_SEC + r0.ru_utime.tv_nsec;
+    uint64 ut1 = r1.ru_utime.tv_sec * NSEC_PER_SEC + r1.ru_utime.tv_nsec;
+    if (ut1 <= ut0) {
+        printf("%s: child user time was not accounted\n", s);
+        exit(1);
+    }
+}
+
+// the sampling profiler records user-mode samples of a spinning
+// process through /dev/prof.
+void proftest(char* s)
+{
+    int fd = open("/dev/prof", O_RDWR);
+    if (fd < 0) {
+        printf("%s: cannot open /dev/prof\n", s);
+        exit(1);
+    }
+    if (write(fd, "x", 1) != -1) {
+        printf("%s: /dev/prof accepted a bad rate\n", s);
+        exit(1);
+    }
+    if (write(fd, "5000", 4) != 4) {
+        printf("%s: cannot start sampling\n", s);
+        exit(1);
+    }
+    // echo writes the newline separately; it must not stop sampling.
+    if (write(fd, "\n", 1) != 1) {
+        printf("%s: /dev/prof rejected a bare newline\n", s);
+        exit(1);
+    }
+
+    int start = uptime();
+    while (uptime() - start < 3)
+        for (volatile int i = 0; i < 100000; i++)
+            ;
+
+    if (write(fd, "0", 1) != 1) {
+        printf("%s: cannot stop sampling\n", s);
+        exit(1);
+    }
+
+    static struct profsample buf[64];
+    int n, mine = 0;
+    while ((n = read(fd, (char*)buf, sizeof(buf))) > 0) {
+        if (n % sizeof(buf[0]) != 0) {
+            printf("%s: read a partial sample\n", s);
+            exit(1);
+        }
+        for (int i = 0; i < n / sizeof(buf[0]); i++)
+            if (buf[i].pid == getpid() && buf[i].mode == PROF_USER)
+                mine++;
+    }
+    close(fd);
+    if (mine == 0) {
+        printf("%s: no user samples of this process\n", s);
+        exit(1);
+    }
+}
+
+// the syscall tracepoints record entry and exit of this process's
+// system calls through /dev/trace, with the return value on exit.
+void tracetest(char* s)
+{
+    int fd = open("/dev/trace", O_RDWR);
+    if (fd < 0) {
+        printf("%s: cannot open /dev/trace\n", s);
+        exit(1);
+    }
+    if (write(fd, "64", 2) != -1) {
+        printf("%s: /dev/trace accepted a bad mask\n", s);
+        exit(1);
+    }
+    if (write(fd, "1", 1) != 1) {
+        printf("%s: cannot start tracing\n", s);
+        exit(1);
+    }
+    // echo writes the newline separately; it must not stop tracing.
+    if (write(fd, "\n", 1) != 1) {
+        printf("%s: /dev/trace rejected a bare newline\n", s);
+        exit(1);
+    }
+
+    int pid = getpid();
+    for (int i = 0; i < 10; i++)
+        getpid();
+
+    if (write(fd, "0", 1) != 1) {
+        printf("%s: cannot stop tracing\n", s);
+        exit(1);
+    }
+
+    static struct tracerec buf[64];
+    int n, enter = 0, exit_ = 0;
+    while ((n = read(fd, (char*)buf, sizeof(buf))) > 0) {
+        if (n % sizeof(buf[0]) != 0) {
+            printf("%s: read a partial record\n", s);
+            exit(1);
+        }
+        for (int i = 0; i < n / sizeof(buf[0]); i++) {
+            struct tracerec* r = &buf[i];
+            if (TRACE_CAT(r->event) != 0) {
+                printf("%s: event %x from a disabled category\n", s, r->event);
+                exit(1);
+            }
+            if (r->pid != pid || r->arg0 != SYS_getpid)
+                continue;
+            if (r->event == TR_SYSCALL_ENTER)
+                enter++;
+            else if (r->event == TR_SYSCALL_EXIT && r->arg1 == pid)
+                exit_++;
+        }
+    }
+    close(fd);
+    if (enter < 10 || exit_ < 10) {
+        printf("%s: traced %d getpid entries and %d exits, expected 10\n", s, enter, exit_);
+        exit(1);
+    }
+}
+
+// CPU-bound processes share the CPU in proportion to their nice
+// weights: a nice 19 spinner (weight 15) competing with nice 0
+// spinners (weight 1024) should get almost no CPU time.
+void fairshare(char* s)
+{
+    // enough spinners to keep every CPU contended, and a warm-up long
+    // enough for each of them to have run once before counting starts.
+    enum { NSPIN = 16, WARMUP = 20, DURATION = 10 };
+    int fds[2];
+    if (pipe(fds) < 0) {
+        printf("%s: pipe failed\n", s);
+        exit(1);
+    }
+
+    int start = uptime() + WARMUP;
+    for (int i = 0; i <= NSPIN; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("%s: fork failed\n", s);
+            exit(1);
+        }
+        if (pid == 0) {
+            int nice = i == NSPIN ? 19 : 0;
+            if (setpriority(0, nice) < 0 || getpriority(0) != 20 - nice) {
+                printf("%s: setpriority %d failed\n", s, nice);
+                exit(1);
+            }
+            while (uptime() < start)
+                ;
+            int r[2] = { nice, 0 };
+            while (uptime() < start + DURATION)
+                r[1]++;
+            write(fds[1], (char*)r, sizeof(r));
+            exit(0);
+        }
+    }
+    close(fds[1]);
+
+    int low = 0, high = 0, r[2];
+    for (int i = 0; i <= NSPIN; i++) {
+        if (read(fds[0], r, sizeof(r)) != sizeof(r)) {
+            printf("%s: read failed\n", s);
+            exit(1);
+        }
+        if (r[0] == 19)
+            low = r[1];
+        else
+            high += r[1];
+    }
+    close(fds[0]);
+    for (int i = 0; i <= NSPIN; i++) {
+        int xstatus;
+        wait(&xstatus);
+        if (xstatus != 0)
+            exit(1);
+    }
+
+    if (low * 4 > high / NSPIN) {
+        printf("%s: nice 19 spinner got %d, nice 0 spinners %d on average\n", s, low, high / NSPIN);
+        exit(1);
+    }
+    if (setpriority(0, 20) != -1 || getpriority(-1) != -1) {
+        printf("%s: bad setpriority/getpriority succeeded\n", s);
+        exit(1);
+    }
+}
+
+void sbrkbasic(char* s)
+{
+    enum { TOOMUCH = 1024 * 1024 * 1024 };
+    int i, pid, xstatus;
+    char *c, *a, *b;
+
+    // does sbrk() return the expected failure value?
+    pid = fork();
+    if (pid < 0) {
+        printf("fork failed in sbrkbasic\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        a = sbrk(TOOMUCH);
+        if (a == (char*)0xffffffffffffffffL) {
+            // it's OK if this fails.
+            exit(0);
+        }
+
+        for (b = a; b < a + TOOMUCH; b += 4096) {
+            *b = 99;
+        }
+
+        // we should not get here! either sbrk(TOOMUCH)
+        // should have failed, or (with lazy allocation)
+        // a pagefault should have killed this process.
+        exit(1);
+    }
+
+    wait(&xstatus);
+    if (xstatus == 1) {
+        printf("%s: too much memory allocated!\n", s);
+        exit(1);
+    }
+
+    // can one sbrk() less than a page?
+    a = sbrk(0);
+    for (i = 0; i < 5000; i++) {
+        b = sbrk(1);
+        if (b != a) {
+            printf("%s: sbrk test failed %d %p %p\n", s, i, a, b);
+            exit(1);
+        }
+        *b = 1;
+        a = b + 1;
+    }
+    pid = fork();
+    if (pid < 0) {
+        printf("%s: sbrk test fork failed\n", s);
+        exit(1);
+    }
+    c = sbrk(1);
+    c = sbrk(1);
+    if (c != a + 1) {
+        printf("%s: sbrk test failed post-fork\n", s);
+        exit(1);
+    }
+    if (pid == 0)
+        exit(0);
+    wait(&xstatus);
+    exit(xstatus);
+}
+
+void sbrkmuch(char* s)
+{
+    enum { BIG = 100 * 1024 * 1024 };
+    char *c, *oldbrk, *a, *lastaddr, *p;
+    uint64 amt;
+
+    oldbrk = sbrk(0);
+
+    // can one grow address space to something big?
+    a = sbrk(0);
+    amt = BIG - (uint64)a;
+    p = sbrk(amt);
+    if (p != a) {
+        printf("%s: sbrk test failed to grow big address space; enough phys mem?\n", s);
+        exit(1);
+    }
+
+    // touch each page to make sure it exists.
+    char* eee = sbrk(0);
+    for (char* pp = a; pp < eee; pp += 4096)
+        *pp = 1;
+
+    lastaddr = (char*)(BIG - 1);
+    *lastaddr = 99;
+
+    // can one de-allocate?
+    a = sbrk(0);
+    c = sbrk(-PGSIZE);
+    if (c == (char*)0xffffffffffffffffL) {
+        printf("%s: sbrk could not deallocate\n", s);
+        exit(1);
+    }
+    c = sbrk(0);
+    if (c != a - PGSIZE) {
+        printf("%s: sbrk deallocation produced wrong address, a %p c %p\n", s, a, c);
+        exit(1);
+    }
+
+    // can one re-allocate that page?
+    a = sbrk(0);
+    c = sbrk(PGSIZE);
+    if (c != a || sbrk(0) != a + PGSIZE) {
+        printf("%s: sbrk re-allocation failed, a %p c %p\n", s, a, c);
+        exit(1);
+    }
+    if (*lastaddr == 99) {
+        // should be zero
+        printf("%s: sbrk de-allocation didn't really deallocate\n", s);
+        exit(1);
+    }
+
+    a = sbrk(0);
+    c = sbrk(-(sbrk(0) - oldbrk));
+    if (c != a) {
+        printf("%s: sbrk downsize failed, a %p c %p\n", s, a, c);
+        exit(1);
+    }
+}
+
+// can we read the kernel's memory?
+void kernmem(char* s)
+{
+    char* a;
+    int pid;
+
+    for (a = (char*)(KERNBASE); a < (char*)(KERNBASE + 2000000); a += 50000) {
+        pid = fork();
+        if (pid < 0) {
+            printf("%s: fork failed\n", s);
+            exit(1);
+        }
+        if (pid == 0) {
+            printf("%s: oops could read %p = %x\n", s, a, *a);
+            exit(1);
+        }
+        int xstatus;
+        wait(&xstatus);
+        if (xstatus != -1) // did kernel kill child?
+            exit(1);
+    }
+}
+
+// user code should not be able to write to addresses above MAXVA.
+void MAXVAplus(char* s)
+{
+    volatile uint64 a = MAXVA;
+    for (; a != 0; a <<= 1) {
+        int pid;
+        pid = fork();
+        if (pid < 0) {
+            printf("%s: fork failed\n", s);
+            exit(1);
+        }
+        if (pid == 0) {
+            *(char*)a = 99;
+            printf("%s: oops wrote %p\n", s, (void*)a);
+            exit(1);
+        }
+        int xstatus;
+        wait(&xstatus);
+        if (xstatus != -1) // did kernel kill child?
+            exit(1);
+    }
+}
+
+// if we run the system out of memory, does it clean up the last
+// failed allocation?
+void sbrkfail(char* s)
+{
+    enum { BIG = 100 * 1024 * 1024 };
+    int i, xstatus;
+    int fds[2];
+    char scratch;
+    char *c, *a;
+    int pids[10];
+    int pid;
+
+    if (pipe(fds) != 0) {
+        printf("%s: pipe() failed\n", s);
+        exit(1);
+    }
+    for (i = 0; i < sizeof(pids) / sizeof(pids[0]); i++) {
+        if ((pids[i] = fork()) == 0) {
+            // allocate a lot of memory
+            sbrk(BIG - (uint64)sbrk(0));
+            write(fds[1], "x", 1);
+            // sit around until killed
+            for (;;)
+                sleep(1000);
+        }
+        if (pids[i] != -1)
+            read(fds[0], &scratch, 1);
+    }
+
+    // if those failed allocations freed up the pages they did allocate,
+    // we'll be able to allocate here
+    c = sbrk(PGSIZE);
+    for (i = 0; i < sizeof(pids) / sizeof(pids[0]); i++) {
+        if (pids[i] == -1)
+            continue;
+        kill(pids[i]);
+        wait(0);
+    }
+    if (c == (char*)0xffffffffffffffffL) {
+        printf("%s: failed sbrk leaked memory\n", s);
+        exit(1);
+    }
+
+    // test running fork with the above allocated page
+    pid = fork();
+    if (pid < 0) {
+        printf("%s: fork failed\n", s);
+        exit(1);
+    }
+    if (pid == 0) {
         // allocate a lot of memory.
         // this should produce a page fault,
         // and thus not complete.
@@ -2369,6 +3397,39 @@ void stacktest(char* s)
         exit(xstatus);
 }
 
+// system calls must not read or write the stack guard page below
+// the user stack, whether the kernel copies through the user window
+// or walks the page table.
+void stackguard(char* s)
+{
+    char* guard = (char*)(PGROUNDDOWN(r_sp()) - USERSTACK * PGSIZE);
+
+    int fds[2];
+    if (pipe(fds) < 0) {
+        printf("%s: pipe failed\n", s);
+        exit(1);
+    }
+    if (write(fds[1], "xyz", 3) != 3) {
+        printf("%s: pipe write failed\n", s);
+        exit(1);
+    }
+    if (read(fds[0], guard, 3) != -1) {
+        printf("%s: read() into the stack guard page succeeded\n", s);
+        exit(1);
+    }
+    if (write(fds[1], guard, 3) != -1) {
+        printf("%s: write() from the stack guard page succeeded\n", s);
+        exit(1);
+    }
+    close(fds[0]);
+    close(fds[1]);
+
+    if (open(guard, O_RDONLY) != -1) {
+        printf("%s: open() of a path in the stack guard page succeeded\n", s);
+        exit(1);
+    }
+}
+
 // check that writes to a few forbidden addresses
 // cause a fault, e.g. process's text and TRAMPOLINE.
 void nowrite(char* s)
@@ -2540,6 +3601,7 @@ struct test {
     { dirtest, "dirtest" },
     { exectest, "exectest" },
     { pipe1, "pipe1" },
+    { pipepingpong, "pipepingpong" },
     { killstatus, "killstatus" },
     { preempt, "preempt" },
     { exitwait, "exitwait" },
@@ -2564,6 +3626,19 @@ struct test {
     { dirfile, "dirfile" },
     { iref, "iref" },
     { forktest, "forktest" },
+    { cowfork, "cowfork" },
+    { lazysbrk, "lazysbrk" },
+    { mmapfile, "mmapfile" },
+    { mmapfork, "mmapfork" },
+    { hugemmap, "hugemmap" },
+    { nanosleeptest, "nanosleep" },
+    { futextest, "futex" },
+    { threadtest, "threads" },
+    { forkfutex, "forkfutex" },
+    { waitpidtest, "waitpid" },
+    { rusagetest, "rusage" },
+    { proftest, "prof" },
+    { tracetest, "trace" },
     { sbrkbasic, "sbrkbasic" },
     { sbrkmuch, "sbrkmuch" },
     { kernmem, "kernmem" },
@@ -2575,6 +3650,7 @@ struct test {
     { bigargtest, "bigargtest" },
     { argptest, "argptest" },
     { stacktest, "stacktest" },
+    { stackguard, "stackguard" },
     { nowrite, "nowrite" },
     { pgbug, "pgbug" },
     { sbrkbugs, "sbrkbugs" },
@@ -2871,6 +3947,7 @@ struct test slowtests[] = {
     { execout, "execout" },
     { diskfull, "diskfull" },
     { outofinodes, "outofinodes" },
+    { fairshare, "fairshare" },
 
     { 0, 0 },
 };
@@ -34,3 +34,15 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("mmap");
+entry("munmap");
+entry("setpriority");
+entry("getpriority");
+entry("nanosleep");
+entry("clock_gettime");
+entry("futex_wait");
+entry("futex_wake");
+entry("clone");
+entry("join");
+entry("waitpid");
+entry("getrusage");